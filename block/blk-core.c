@@ -1096,6 +1096,9 @@ void __blk_put_request(struct request_queue *q, struct request *req)
 	/* this is a bio leak */
 	WARN_ON(req->bio != NULL);
 
+	if (req->cmd_flags & REQ_LAT_THROTTLE)
+		bdi_lat_write_done(&q->backing_dev_info);
+
 	/*
 	 * Request may not have originated from ll_rw_blk. if not,
 	 * it didn't come out of our reserved rq pools
@@ -1271,6 +1274,7 @@ static int __make_request(struct request_queue *q, struct bio *bio)
 	int el_ret, rw_flags, where = ELEVATOR_INSERT_SORT;
 	struct request *req;
 	unsigned int request_count = 0;
+	bool lat_throttle = false;
 
 	/*
 	 * low level driver can indicate that it wants pages above a
@@ -1319,6 +1323,17 @@ get_rq:
 	if (sync)
 		rw_flags |= REQ_SYNC;
 
+	/*
+	 * Background writes wait here while reads from this queue miss
+	 * their latency target, see bdi_lat_throttle().
+	 */
+	if (q->backing_dev_info.lat_target_usec &&
+	    rw_flags == WRITE &&
+	    !(bio->bi_rw & (REQ_DISCARD | REQ_FLUSH | REQ_FUA))) {
+		bdi_lat_throttle(&q->backing_dev_info, q->queue_lock);
+		lat_throttle = true;
+	}
+
 	/*
 	 * Grab a free request. This is might sleep but can not fail.
 	 * Returns with the queue unlocked.
@@ -1332,6 +1347,8 @@ get_rq:
 	 * often, and the elevators are able to handle it.
 	 */
 	init_request_from_bio(req, bio);
+	if (lat_throttle)
+		req->cmd_flags |= REQ_LAT_THROTTLE;
 
 	if (test_bit(QUEUE_FLAG_SAME_COMP, &q->queue_flags) ||
 	    bio_flagged(bio, BIO_CPU_AFFINE))
@@ -2275,6 +2292,10 @@ static void blk_finish_request(struct request *req, int error)
 	if (unlikely(laptop_mode) && req->cmd_type == REQ_TYPE_FS)
 		laptop_io_completion(&req->q->backing_dev_info);
 
+	if (req->cmd_type == REQ_TYPE_FS && rq_data_dir(req) == READ)
+		bdi_lat_read_done(&req->q->backing_dev_info,
+				  rq_start_time_ns(req));
+
 	blk_delete_timer(req);
 
 	if (req->cmd_flags & REQ_DONTPREP)
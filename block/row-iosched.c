@@ -85,6 +85,28 @@ static const struct row_queue_params row_queues_def[] = {
 #define ROW_IDLE_TIME_MSEC 5
 #define ROW_READ_FREQ_MSEC 20
 
+/* Default number of requests moved per dispatch call */
+#define ROW_DISPATCH_BATCH 1
+
+/*
+ * enum row_lat_class - request classes for completion latency statistics
+ *
+ * Reads are always synchronous, so the async class holds writes only.
+ */
+enum row_lat_class {
+	ROW_LAT_READ_SYNC = 0,
+	ROW_LAT_WRITE_SYNC,
+	ROW_LAT_ASYNC,
+	ROW_LAT_MAX_CLASS,
+};
+
+/*
+ * Latency histogram buckets: bucket 0 counts requests that completed
+ * in less than 1 msec, bucket i counts [2^(i-1), 2^i) msec and the last
+ * bucket everything above.
+ */
+#define ROW_LAT_BUCKETS 12
+
 /**
  * struct rowq_idling_data -  parameters for idling on the queue
  * @last_insert_time:	time the last request was inserted
@@ -153,6 +175,10 @@ struct idling_data {
  *			scheduler, nr_reqs[1] holds the number of all WRITE
  *			requests in scheduler
  * @cycle_flags:	used for marking unserved queueus
+ * @dispatch_batch:	max number of requests moved from the current
+ *			queue to the dispatch queue in one dispatch call
+ * @lat_hist:		insert to completion latency histograms, per
+ *			enum row_lat_class
  *
  */
 struct row_data {
@@ -166,10 +192,20 @@ struct row_data {
 	unsigned int			nr_reqs[2];
 
 	unsigned int			cycle_flags;
+
+	int				dispatch_batch;
+	unsigned long	lat_hist[ROW_LAT_MAX_CLASS][ROW_LAT_BUCKETS];
 };
 
 #define RQ_ROWQ(rq) ((struct row_queue *) ((rq)->elevator_private[0]))
 
+/*
+ * Insertion time of the request in usec, truncated to unsigned long.
+ * Only differences are used, so wrap around is harmless.
+ */
+#define RQ_INSERT_TIME(rq) ((unsigned long)((rq)->elevator_private[1]))
+#define RQ_SET_INSERT_TIME(rq, t) ((rq)->elevator_private[1] = (void *)(t))
+
 #define row_log(q, fmt, args...)   \
 	blk_add_trace_msg(q, "%s():" fmt , __func__, ##args)
 #define row_log_rowq(rdata, rowq_id, fmt, args...)		\
@@ -281,6 +317,7 @@ static void row_add_request(struct request_queue *q,
 	rd->nr_reqs[rq_data_dir(rq)]++;
 	rqueue->nr_req++;
 	rq_set_fifo_time(rq, jiffies); /* for statistics*/
+	RQ_SET_INSERT_TIME(rq, (unsigned long)ktime_to_us(ktime_get()));
 
 	if (row_queues_def[rqueue->prio].idling_enabled) {
 		if (delayed_work_pending(&rd->read_idle.idle_work))
@@ -402,6 +439,34 @@ static void row_dispatch_insert(struct row_data *rd)
 		     rd->row_queues[rd->curr_queue].nr_dispatched);
 }
 
+/*
+ * row_dispatch_batch() - move more requests from rd->curr_queue
+ * @rd:	pointer to struct row_data
+ *
+ * Called after a request was dispatched from rd->curr_queue. Moves up
+ * to dispatch_batch - 1 additional requests from the same queue to the
+ * dispatch queue, without exceeding the queue's dispatch quantum.
+ * This lets the driver fetch several requests under one queue_lock
+ * round trip instead of calling back into the scheduler for each one.
+ *
+ */
+static void row_dispatch_batch(struct row_data *rd)
+{
+	struct row_queue *rqueue = &rd->row_queues[rd->curr_queue];
+	int nr_disp = 1;
+
+	while (nr_disp < rd->dispatch_batch &&
+	       !list_empty(&rqueue->fifo) &&
+	       rqueue->nr_dispatched < rqueue->disp_quantum) {
+		row_dispatch_insert(rd);
+		nr_disp++;
+	}
+
+	if (nr_disp > 1)
+		row_log_rowq(rd, rd->curr_queue, "Dispatched batch of %d",
+			     nr_disp);
+}
+
 /*
  * row_choose_queue() -  choose the next queue to dispatch from
  * @rd:	pointer to struct row_data
@@ -519,6 +584,8 @@ static int row_dispatch_requests(struct request_queue *q, int force)
 	row_dispatch_insert(rd);
 
 done:
+	if (ret)
+		row_dispatch_batch(rd);
 	return ret;
 }
 
@@ -569,6 +636,7 @@ static void *row_init_queue(struct request_queue *q)
 
 	rdata->curr_queue = ROWQ_PRIO_HIGH_READ;
 	rdata->dispatch_queue = q;
+	rdata->dispatch_batch = ROW_DISPATCH_BATCH;
 
 	rdata->nr_reqs[READ] = rdata->nr_reqs[WRITE] = 0;
 
@@ -610,6 +678,38 @@ static void row_merged_requests(struct request_queue *q, struct request *rq,
 	rqueue->rdata->nr_reqs[rq_data_dir(rq)]--;
 }
 
+/*
+ * row_completed_request() - Called when a request is completed
+ * @q:		requests queue
+ * @rq:		request that was completed
+ *
+ * Accounts the time from insertion into the scheduler to completion
+ * in the latency histogram of the request's class.
+ */
+static void row_completed_request(struct request_queue *q,
+				  struct request *rq)
+{
+	struct row_data *rd = q->elevator->elevator_data;
+	unsigned long lat_ms;
+	int class, bucket;
+
+	if (!RQ_INSERT_TIME(rq))
+		return;
+
+	lat_ms = ((unsigned long)ktime_to_us(ktime_get()) -
+		  RQ_INSERT_TIME(rq)) / USEC_PER_MSEC;
+	bucket = min_t(int, fls_long(lat_ms), ROW_LAT_BUCKETS - 1);
+
+	if (rq_data_dir(rq) == READ)
+		class = ROW_LAT_READ_SYNC;
+	else if (rq_is_sync(rq))
+		class = ROW_LAT_WRITE_SYNC;
+	else
+		class = ROW_LAT_ASYNC;
+
+	rd->lat_hist[class][bucket]++;
+}
+
 /*
  * get_queue_type() - Get queue type for a given request
  *
@@ -649,6 +749,7 @@ row_set_request(struct request_queue *q, struct request *rq, gfp_t gfp_mask)
 	spin_lock_irqsave(q->queue_lock, flags);
 	rq->elevator_private[0] =
 		(void *)(&rd->row_queues[get_queue_type(rq)]);
+	RQ_SET_INSERT_TIME(rq, 0);
 	spin_unlock_irqrestore(q->queue_lock, flags);
 
 	return 0;
@@ -693,6 +794,7 @@ SHOW_FUNCTION(row_lp_swrite_quantum_show,
 	rowd->row_queues[ROWQ_PRIO_LOW_SWRITE].disp_quantum, 0);
 SHOW_FUNCTION(row_read_idle_show, rowd->read_idle.idle_time, 0);
 SHOW_FUNCTION(row_read_idle_freq_show, rowd->read_idle.freq, 0);
+SHOW_FUNCTION(row_dispatch_batch_show, rowd->dispatch_batch, 0);
 #undef SHOW_FUNCTION
 
 #define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
@@ -733,12 +835,40 @@ STORE_FUNCTION(row_lp_swrite_quantum_store,
 			1, INT_MAX, 1);
 STORE_FUNCTION(row_read_idle_store, &rowd->read_idle.idle_time, 1, INT_MAX, 0);
 STORE_FUNCTION(row_read_idle_freq_store, &rowd->read_idle.freq, 1, INT_MAX, 0);
+STORE_FUNCTION(row_dispatch_batch_store, &rowd->dispatch_batch, 1, INT_MAX, 0);
 
 #undef STORE_FUNCTION
 
+static ssize_t row_lat_hist_show(unsigned long *hist, char *page)
+{
+	ssize_t len = 0;
+	int i;
+
+	len += sprintf(page + len, "<1ms %lu\n", hist[0]);
+	for (i = 1; i < ROW_LAT_BUCKETS - 1; i++)
+		len += sprintf(page + len, "<%lums %lu\n", 1UL << i, hist[i]);
+	len += sprintf(page + len, ">=%lums %lu\n",
+		       1UL << (ROW_LAT_BUCKETS - 2), hist[i]);
+
+	return len;
+}
+
+#define LAT_HIST_SHOW_FUNCTION(__FUNC, __CLASS)				\
+static ssize_t __FUNC(struct elevator_queue *e, char *page)		\
+{									\
+	struct row_data *rowd = e->elevator_data;			\
+	return row_lat_hist_show(rowd->lat_hist[__CLASS], page);	\
+}
+LAT_HIST_SHOW_FUNCTION(row_read_sync_lat_hist_show, ROW_LAT_READ_SYNC);
+LAT_HIST_SHOW_FUNCTION(row_write_sync_lat_hist_show, ROW_LAT_WRITE_SYNC);
+LAT_HIST_SHOW_FUNCTION(row_async_lat_hist_show, ROW_LAT_ASYNC);
+#undef LAT_HIST_SHOW_FUNCTION
+
 #define ROW_ATTR(name) \
 	__ATTR(name, S_IRUGO|S_IWUSR, row_##name##_show, \
 				      row_##name##_store)
+#define ROW_ATTR_RO(name) \
+	__ATTR(name, S_IRUGO, row_##name##_show, NULL)
 
 static struct elv_fs_entry row_attrs[] = {
 	ROW_ATTR(hp_read_quantum),
@@ -750,6 +880,10 @@ static struct elv_fs_entry row_attrs[] = {
 	ROW_ATTR(lp_swrite_quantum),
 	ROW_ATTR(read_idle),
 	ROW_ATTR(read_idle_freq),
+	ROW_ATTR(dispatch_batch),
+	ROW_ATTR_RO(read_sync_lat_hist),
+	ROW_ATTR_RO(write_sync_lat_hist),
+	ROW_ATTR_RO(async_lat_hist),
 	__ATTR_NULL
 };
 
@@ -758,6 +892,7 @@ static struct elevator_type iosched_row = {
 		.elevator_merge_req_fn		= row_merged_requests,
 		.elevator_dispatch_fn		= row_dispatch_requests,
 		.elevator_add_req_fn		= row_add_request,
+		.elevator_completed_req_fn	= row_completed_request,
 		.elevator_reinsert_req_fn	= row_reinsert_req,
 		.elevator_is_urgent_fn		= row_urgent_pending,
 		.elevator_former_req_fn		= elv_rb_former_request,
@@ -5,13 +5,18 @@
  * Copyright (C) 2012 Miguel Boton <mboton@gmail.com>
  *
  *
- * This algorithm does not do any kind of sorting, as it is aimed for
- * aleatory access devices, but it does some basic merging. We try to
- * keep minimum overhead to achieve low latency.
+ * By default this algorithm does not do any kind of sorting, as it is
+ * aimed for aleatory access devices, but it does some basic merging. We
+ * try to keep minimum overhead to achieve low latency.
  *
  * Asynchronous and synchronous requests are not treated separately, but
  * we relay on deadlines to ensure fairness.
  *
+ * Optionally (sort_sectors) requests of each fifo are served in ascending
+ * sector order as long as the oldest one has not expired, and front merges
+ * are looked up in the sector sorted trees. Small scattered writes on flash
+ * benefit from being issued in sector order.
+ *
  */
 #include <linux/blkdev.h>
 #include <linux/elevator.h>
@@ -19,6 +24,8 @@
 #include <linux/module.h>
 #include <linux/init.h>
 #include <linux/version.h>
+#include <linux/rbtree.h>
+#include <linux/ktime.h>
 
 enum { ASYNC, SYNC };
 
@@ -32,22 +39,95 @@ static const int async_write_expire = 800;	/* ditto for async, these limits are
 static const int writes_starved = 2;		/* max times reads can starve a write */
 static const int fifo_batch     = 8;		/* # of sequential requests treated as one
 						   by the above parameters. For throughput. */
+static const int sort_sectors   = 0;		/* serve each fifo in sector order. */
+
+/*
+ * Completion latency histogram: bucket i counts requests that took
+ * [2^i, 2^(i+1)) usec from insertion to completion, the last bucket
+ * everything above.
+ */
+#define SIO_LAT_BUCKETS 24
+
+#define RQ_INSERT_TIME(rq)	((unsigned long)((rq)->elevator_private[0]))
+#define RQ_SET_INSERT_TIME(rq, t) ((rq)->elevator_private[0] = (void *)(t))
 
 /* Elevator data */
 struct sio_data {
 	/* Request queues */
 	struct list_head fifo_list[2][2];
+	struct rb_root sort_list[2][2];
 
 	/* Attributes */
 	unsigned int batched;
 	unsigned int starved;
+	sector_t head_sector;
+
+	/* Statistics */
+	unsigned long lat_hist[2][SIO_LAT_BUCKETS];
 
 	/* Settings */
 	int fifo_expire[2][2];
 	int fifo_batch;
 	int writes_starved;
+	int sort_sectors;
 };
 
+static inline struct rb_root *
+sio_rb_root(struct sio_data *sd, struct request *rq)
+{
+	return &sd->sort_list[rq_is_sync(rq)][rq_data_dir(rq)];
+}
+
+static inline void
+sio_remove_request(struct sio_data *sd, struct request *rq)
+{
+	rq_fifo_clear(rq);
+	elv_rb_del(sio_rb_root(sd, rq), rq);
+}
+
+static int
+sio_merge(struct request_queue *q, struct request **req, struct bio *bio)
+{
+	struct sio_data *sd = q->elevator->elevator_data;
+	const int data_dir = bio_data_dir(bio);
+	const int sync = data_dir == READ || (bio->bi_rw & REQ_SYNC);
+	sector_t sector = bio->bi_sector + bio_sectors(bio);
+	struct request *__rq;
+
+	/*
+	 * Check for front merge, back merges are found through the
+	 * elevator hash.
+	 */
+	if (!sd->sort_sectors)
+		return ELEVATOR_NO_MERGE;
+
+	__rq = elv_rb_find(&sd->sort_list[sync][data_dir], sector);
+	if (__rq) {
+		BUG_ON(sector != blk_rq_pos(__rq));
+
+		if (elv_rq_merge_ok(__rq, bio)) {
+			*req = __rq;
+			return ELEVATOR_FRONT_MERGE;
+		}
+	}
+
+	return ELEVATOR_NO_MERGE;
+}
+
+static void
+sio_merged_request(struct request_queue *q, struct request *req, int type)
+{
+	struct sio_data *sd = q->elevator->elevator_data;
+
+	/*
+	 * If the merge was a front merge, reposition the request.
+	 */
+	if (type == ELEVATOR_FRONT_MERGE) {
+		elv_rb_del(sio_rb_root(sd, req), req);
+		elv_rb_add(sio_rb_root(sd, req), req);
+	}
+}
+
 static void
 sio_merged_requests(struct request_queue *q, struct request *rq,
 		    struct request *next)
@@ -64,7 +144,7 @@ sio_merged_requests(struct request_queue *q, struct request *rq,
 	}
 
 	/* Delete next request */
-	rq_fifo_clear(next);
+	sio_remove_request(q->elevator->elevator_data, next);
 }
 
 static void
@@ -80,6 +160,25 @@ sio_add_request(struct request_queue *q, struct request *rq)
 	 */
 	rq_set_fifo_time(rq, jiffies + sd->fifo_expire[sync][data_dir]);
 	list_add_tail(&rq->queuelist, &sd->fifo_list[sync][data_dir]);
+	elv_rb_add(&sd->sort_list[sync][data_dir], rq);
+
+	RQ_SET_INSERT_TIME(rq, (unsigned long)ktime_to_us(ktime_get()));
+}
+
+static void
+sio_completed_request(struct request_queue *q, struct request *rq)
+{
+	struct sio_data *sd = q->elevator->elevator_data;
+	unsigned long lat;
+	int bucket;
+
+	/*
+	 * Account insertion to completion latency per direction.
+	 */
+	lat = (unsigned long)ktime_to_us(ktime_get()) - RQ_INSERT_TIME(rq);
+	bucket = lat ? min_t(int, __fls(lat), SIO_LAT_BUCKETS - 1) : 0;
+
+	sd->lat_hist[rq_data_dir(rq)][bucket]++;
 }
 
 #if LINUX_VERSION_CODE <= KERNEL_VERSION(2,6,38)
@@ -140,6 +239,49 @@ sio_choose_expired_request(struct sio_data *sd)
 	return NULL;
 }
 
+static struct request *
+sio_sorted_request(struct sio_data *sd, int sync, int data_dir)
+{
+	struct rb_node *node = sd->sort_list[sync][data_dir].rb_node;
+	struct request *rq = NULL;
+
+	/*
+	 * Keep the deadline: the oldest request goes first once it
+	 * has expired.
+	 */
+	rq = sio_expired_request(sd, sync, data_dir);
+	if (rq)
+		return rq;
+
+	/*
+	 * Otherwise continue from the last dispatched sector upwards,
+	 * wrapping around to the lowest sector.
+	 */
+	while (node) {
+		struct request *__rq = rb_entry_rq(node);
+
+		if (blk_rq_pos(__rq) >= sd->head_sector) {
+			rq = __rq;
+			node = node->rb_left;
+		} else
+			node = node->rb_right;
+	}
+
+	if (!rq)
+		rq = rb_entry_rq(rb_first(&sd->sort_list[sync][data_dir]));
+
+	return rq;
+}
+
+static inline struct request *
+sio_next_request(struct sio_data *sd, int sync, int data_dir)
+{
+	if (sd->sort_sectors)
+		return sio_sorted_request(sd, sync, data_dir);
+
+	return rq_entry_fifo(sd->fifo_list[sync][data_dir].next);
+}
+
 static struct request *
 sio_choose_request(struct sio_data *sd, int data_dir)
 {
@@ -152,14 +294,14 @@ sio_choose_request(struct sio_data *sd, int data_dir)
 	 * Read requests have priority over write.
 	 */
 	if (!list_empty(&sync[data_dir]))
-		return rq_entry_fifo(sync[data_dir].next);
+		return sio_next_request(sd, SYNC, data_dir);
 	if (!list_empty(&async[data_dir]))
-		return rq_entry_fifo(async[data_dir].next);
+		return sio_next_request(sd, ASYNC, data_dir);
 
 	if (!list_empty(&sync[!data_dir]))
-		return rq_entry_fifo(sync[!data_dir].next);
+		return sio_next_request(sd, SYNC, !data_dir);
 	if (!list_empty(&async[!data_dir]))
-		return rq_entry_fifo(async[!data_dir].next);
+		return sio_next_request(sd, ASYNC, !data_dir);
 
 	return NULL;
 }
@@ -171,9 +313,10 @@ sio_dispatch_request(struct sio_data *sd, struct request *rq)
 	 * Remove the request from the fifo list
 	 * and dispatch it.
 	 */
-	rq_fifo_clear(rq);
+	sio_remove_request(sd, rq);
 	elv_dispatch_add_tail(rq->q, rq);
 
+	sd->head_sector = blk_rq_pos(rq) + blk_rq_sectors(rq);
 	sd->batched++;
 
 	if (rq_data_dir(rq))
@@ -221,6 +364,10 @@ sio_former_request(struct request_queue *q, struct request *rq)
 	const int sync = rq_is_sync(rq);
 	const int data_dir = rq_data_dir(rq);
 
+	/* Sector neighbours are the merge candidates when sorting */
+	if (sd->sort_sectors)
+		return elv_rb_former_request(q, rq);
+
 	if (rq->queuelist.prev == &sd->fifo_list[sync][data_dir])
 		return NULL;
 
@@ -235,6 +382,9 @@ sio_latter_request(struct request_queue *q, struct request *rq)
 	const int sync = rq_is_sync(rq);
 	const int data_dir = rq_data_dir(rq);
 
+	if (sd->sort_sectors)
+		return elv_rb_latter_request(q, rq);
+
 	if (rq->queuelist.next == &sd->fifo_list[sync][data_dir])
 		return NULL;
 
@@ -248,7 +398,7 @@ sio_init_queue(struct request_queue *q)
 	struct sio_data *sd;
 
 	/* Allocate structure */
-	sd = kmalloc_node(sizeof(*sd), GFP_KERNEL, q->node);
+	sd = kmalloc_node(sizeof(*sd), GFP_KERNEL | __GFP_ZERO, q->node);
 	if (!sd)
 		return NULL;
 
@@ -257,6 +407,10 @@ sio_init_queue(struct request_queue *q)
 	INIT_LIST_HEAD(&sd->fifo_list[SYNC][WRITE]);
 	INIT_LIST_HEAD(&sd->fifo_list[ASYNC][READ]);
 	INIT_LIST_HEAD(&sd->fifo_list[ASYNC][WRITE]);
+	sd->sort_list[SYNC][READ] = RB_ROOT;
+	sd->sort_list[SYNC][WRITE] = RB_ROOT;
+	sd->sort_list[ASYNC][READ] = RB_ROOT;
+	sd->sort_list[ASYNC][WRITE] = RB_ROOT;
 
 	/* Initialize data */
 	sd->batched = 0;
@@ -265,6 +419,8 @@ sio_init_queue(struct request_queue *q)
 	sd->fifo_expire[ASYNC][READ] = async_read_expire;
 	sd->fifo_expire[ASYNC][WRITE] = async_write_expire;
 	sd->fifo_batch = fifo_batch;
+	sd->writes_starved = writes_starved;
+	sd->sort_sectors = sort_sectors;
 
 	return sd;
 }
@@ -317,6 +473,7 @@ SHOW_FUNCTION(sio_async_read_expire_show, sd->fifo_expire[ASYNC][READ], 1);
 SHOW_FUNCTION(sio_async_write_expire_show, sd->fifo_expire[ASYNC][WRITE], 1);
 SHOW_FUNCTION(sio_fifo_batch_show, sd->fifo_batch, 0);
 SHOW_FUNCTION(sio_writes_starved_show, sd->writes_starved, 0);
+SHOW_FUNCTION(sio_sort_sectors_show, sd->sort_sectors, 0);
 #undef SHOW_FUNCTION
 
 #define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
@@ -341,8 +498,64 @@ STORE_FUNCTION(sio_async_read_expire_store, &sd->fifo_expire[ASYNC][READ], 0, IN
 STORE_FUNCTION(sio_async_write_expire_store, &sd->fifo_expire[ASYNC][WRITE], 0, INT_MAX, 1);
 STORE_FUNCTION(sio_fifo_batch_store, &sd->fifo_batch, 0, INT_MAX, 0);
 STORE_FUNCTION(sio_writes_starved_store, &sd->writes_starved, 0, INT_MAX, 0);
+STORE_FUNCTION(sio_sort_sectors_store, &sd->sort_sectors, 0, 1, 0);
 #undef STORE_FUNCTION
 
+/*
+ * Latency percentiles, reported as the upper bound (usec) of the
+ * histogram bucket holding the percentile.
+ */
+static unsigned long
+sio_lat_percentile(unsigned long *hist, unsigned long total, int pct)
+{
+	unsigned long sum = 0, target;
+	int i;
+
+	target = DIV_ROUND_UP(total * pct, 100);
+	for (i = 0; i < SIO_LAT_BUCKETS - 1; i++) {
+		sum += hist[i];
+		if (sum >= target)
+			break;
+	}
+
+	return 2UL << i;
+}
+
+static ssize_t
+sio_lat_show(unsigned long *hist, char *page)
+{
+	unsigned long total = 0;
+	int i;
+
+	for (i = 0; i < SIO_LAT_BUCKETS; i++)
+		total += hist[i];
+
+	if (!total)
+		return sprintf(page, "0 0 0 0\n");
+
+	/* requests p50 p90 p99 */
+	return sprintf(page, "%lu %lu %lu %lu\n", total,
+		       sio_lat_percentile(hist, total, 50),
+		       sio_lat_percentile(hist, total, 90),
+		       sio_lat_percentile(hist, total, 99));
+}
+
+static ssize_t
+sio_read_latency_show(struct elevator_queue *e, char *page)
+{
+	struct sio_data *sd = e->elevator_data;
+
+	return sio_lat_show(sd->lat_hist[READ], page);
+}
+
+static ssize_t
+sio_write_latency_show(struct elevator_queue *e, char *page)
+{
+	struct sio_data *sd = e->elevator_data;
+
+	return sio_lat_show(sd->lat_hist[WRITE], page);
+}
+
 #define DD_ATTR(name) \
 	__ATTR(name, S_IRUGO|S_IWUSR, sio_##name##_show, \
 				      sio_##name##_store)
@@ -354,14 +567,20 @@ static struct elv_fs_entry sio_attrs[] = {
 	DD_ATTR(async_write_expire),
 	DD_ATTR(fifo_batch),
 	DD_ATTR(writes_starved),
+	DD_ATTR(sort_sectors),
+	__ATTR(read_latency, S_IRUGO, sio_read_latency_show, NULL),
+	__ATTR(write_latency, S_IRUGO, sio_write_latency_show, NULL),
 	__ATTR_NULL
 };
 
 static struct elevator_type iosched_sio = {
 	.ops = {
+		.elevator_merge_fn		= sio_merge,
+		.elevator_merged_fn		= sio_merged_request,
 		.elevator_merge_req_fn		= sio_merged_requests,
 		.elevator_dispatch_fn		= sio_dispatch_requests,
 		.elevator_add_req_fn		= sio_add_request,
+		.elevator_completed_req_fn	= sio_completed_request,
 #if LINUX_VERSION_CODE <= KERNEL_VERSION(2,6,38)
 		.elevator_queue_empty_fn	= sio_queue_empty,
 #endif
@@ -400,4 +619,4 @@ module_exit(sio_exit);
 MODULE_AUTHOR("Miguel Boton");
 MODULE_LICENSE("GPL");
 MODULE_DESCRIPTION("Simple IO scheduler");
-MODULE_VERSION("0.2");
+MODULE_VERSION("0.3");
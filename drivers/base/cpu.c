@@ -333,6 +333,10 @@ int __init cpu_dev_init(void)
 	if (!err)
 		err = sched_create_sysfs_power_savings_entries(&cpu_sysdev_class);
 #endif
+#ifdef CONFIG_SMP
+	if (!err)
+		err = sched_create_sysfs_wake_pack_entries(&cpu_sysdev_class);
+#endif
 
 	cpuplug_wq = alloc_workqueue(
                 "cpu-plug", WQ_UNBOUND | WQ_RESCUER | WQ_FREEZABLE, 1);
@@ -102,6 +102,8 @@ struct mmc_blk_data {
 	 */
 	unsigned int	part_curr;
 	struct device_attribute force_ro;
+	struct device_attribute bkops_idle_ms;
+	struct device_attribute bkops_stats;
 };
 
 static DEFINE_MUTEX(open_lock);
@@ -188,6 +190,60 @@ out:
 	return ret;
 }
 
+static ssize_t bkops_idle_ms_show(struct device *dev,
+				  struct device_attribute *attr, char *buf)
+{
+	int ret;
+	struct mmc_blk_data *md = mmc_blk_get(dev_to_disk(dev));
+
+	ret = snprintf(buf, PAGE_SIZE, "%u\n", md->queue.bkops_idle_ms);
+	mmc_blk_put(md);
+	return ret;
+}
+
+static ssize_t bkops_idle_ms_store(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t count)
+{
+	int ret;
+	char *end;
+	struct mmc_blk_data *md = mmc_blk_get(dev_to_disk(dev));
+	unsigned long set = simple_strtoul(buf, &end, 0);
+	if (end == buf) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	md->queue.bkops_idle_ms = set;
+	ret = count;
+out:
+	mmc_blk_put(md);
+	return ret;
+}
+
+static ssize_t bkops_stats_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	int ret;
+	struct mmc_blk_data *md = mmc_blk_get(dev_to_disk(dev));
+	struct mmc_bkops_stats *st = &md->queue.bkops_stats;
+	u64 avoided_us = 0;
+
+	/* Every deferred start saved the next request an HPI */
+	if (st->hpi)
+		avoided_us = div64_u64(st->hpi_time_us * st->deferred,
+				       st->hpi);
+
+	ret = snprintf(buf, PAGE_SIZE,
+		       "started %u\ndeferred %u\nhpi %u\nhpi_time_us %llu\n"
+		       "avoided_us %llu\n",
+		       st->started, st->deferred, st->hpi,
+		       (unsigned long long)st->hpi_time_us,
+		       (unsigned long long)avoided_us);
+	mmc_blk_put(md);
+	return ret;
+}
+
 static int mmc_blk_open(struct block_device *bdev, fmode_t mode)
 {
 	struct mmc_blk_data *md = mmc_blk_get(bdev->bd_disk);
@@ -1450,6 +1506,10 @@ static void mmc_blk_remove_req(struct mmc_blk_data *md)
 	if (md) {
 		if (md->disk->flags & GENHD_FL_UP) {
 			device_remove_file(disk_to_dev(md->disk), &md->force_ro);
+			device_remove_file(disk_to_dev(md->disk),
+					   &md->bkops_idle_ms);
+			device_remove_file(disk_to_dev(md->disk),
+					   &md->bkops_stats);
 
 			/* Stop new requests from getting into the queue */
 			del_gendisk(md->disk);
@@ -1487,8 +1547,33 @@ static int mmc_add_disk(struct mmc_blk_data *md)
 	md->force_ro.attr.mode = S_IRUGO | S_IWUSR;
 	ret = device_create_file(disk_to_dev(md->disk), &md->force_ro);
 	if (ret)
-		del_gendisk(md->disk);
+		goto del_disk;
+
+	md->bkops_idle_ms.show = bkops_idle_ms_show;
+	md->bkops_idle_ms.store = bkops_idle_ms_store;
+	sysfs_attr_init(&md->bkops_idle_ms.attr);
+	md->bkops_idle_ms.attr.name = "bkops_idle_ms";
+	md->bkops_idle_ms.attr.mode = S_IRUGO | S_IWUSR;
+	ret = device_create_file(disk_to_dev(md->disk), &md->bkops_idle_ms);
+	if (ret)
+		goto remove_force_ro;
+
+	md->bkops_stats.show = bkops_stats_show;
+	sysfs_attr_init(&md->bkops_stats.attr);
+	md->bkops_stats.attr.name = "bkops_stats";
+	md->bkops_stats.attr.mode = S_IRUGO;
+	ret = device_create_file(disk_to_dev(md->disk), &md->bkops_stats);
+	if (ret)
+		goto remove_idle_ms;
+
+	return 0;
 
+remove_idle_ms:
+	device_remove_file(disk_to_dev(md->disk), &md->bkops_idle_ms);
+remove_force_ro:
+	device_remove_file(disk_to_dev(md->disk), &md->force_ro);
+del_disk:
+	del_gendisk(md->disk);
 	return ret;
 }
 
@@ -24,6 +24,23 @@
 
 #define MMC_QUEUE_SUSPENDED	(1 << 0)
 
+/*
+ * How long the queue has to stay idle before background operations
+ * are started. Starting them right when the queue drains makes the
+ * next request pay for an HPI if more I/O follows shortly.
+ */
+#define MMC_QUEUE_BKOPS_IDLE_MS	200
+
+/*
+ * Read latency that background writeback is throttled to keep, see
+ * bdi_lat_throttle().  Tunable as read_lat_target_us in /sys/class/bdi.
+ */
+#define MMC_QUEUE_READ_LAT_US	20000
+
+/* mq->bkops_flags bits */
+#define MMC_QUEUE_BKOPS_DUE	0	/* idle delay expired */
+#define MMC_QUEUE_BKOPS_OFF	1	/* suspended or stopping, don't arm */
+
 /*
  * Prepare a MMC request. This just filters out odd stuff.
  */
@@ -42,6 +59,69 @@ static int mmc_prep_request(struct request_queue *q, struct request *req)
 	return BLKPREP_OK;
 }
 
+static void mmc_queue_bkops_work(struct work_struct *work)
+{
+	struct mmc_queue *mq = container_of(to_delayed_work(work),
+					    struct mmc_queue, bkops_work);
+	struct request_queue *q = mq->queue;
+
+	/* BKOPS are started from the queue thread, serialized with I/O */
+	spin_lock_irq(q->queue_lock);
+	if (!test_bit(MMC_QUEUE_BKOPS_OFF, &mq->bkops_flags)) {
+		set_bit(MMC_QUEUE_BKOPS_DUE, &mq->bkops_flags);
+		wake_up_process(mq->thread);
+	}
+	spin_unlock_irq(q->queue_lock);
+}
+
+/*
+ * The queue went idle and the card asked for background operations:
+ * start them once the idle delay has expired, arm the delay otherwise.
+ * The delay is never armed once suspend or cleanup has set
+ * MMC_QUEUE_BKOPS_OFF under the queue lock.
+ */
+static void mmc_queue_bkops_idle(struct mmc_queue *mq)
+{
+	struct request_queue *q = mq->queue;
+
+	if (!mq->bkops_idle_ms ||
+	    test_and_clear_bit(MMC_QUEUE_BKOPS_DUE, &mq->bkops_flags)) {
+		mmc_bkops_start(mq->card, false, true);
+		if (mmc_card_doing_bkops(mq->card))
+			mq->bkops_stats.started++;
+		return;
+	}
+
+	spin_lock_irq(q->queue_lock);
+	if (!test_bit(MMC_QUEUE_BKOPS_OFF, &mq->bkops_flags) &&
+	    !delayed_work_pending(&mq->bkops_work))
+		schedule_delayed_work(&mq->bkops_work,
+				      msecs_to_jiffies(mq->bkops_idle_ms));
+	spin_unlock_irq(q->queue_lock);
+}
+
+/*
+ * A new request arrived: drop pending background operations. Each one
+ * dropped is an HPI the request did not have to wait for.
+ */
+static void mmc_queue_bkops_cancel(struct mmc_queue *mq)
+{
+	if (cancel_delayed_work(&mq->bkops_work) ||
+	    test_and_clear_bit(MMC_QUEUE_BKOPS_DUE, &mq->bkops_flags))
+		mq->bkops_stats.deferred++;
+}
+
+static void mmc_queue_bkops_interrupt(struct mmc_queue *mq)
+{
+	ktime_t start = ktime_get();
+
+	mmc_interrupt_hpi(mq->card);
+
+	mq->bkops_stats.hpi++;
+	mq->bkops_stats.hpi_time_us +=
+		ktime_to_us(ktime_sub(ktime_get(), start));
+}
+
 static int mmc_queue_thread(void *d)
 {
 	struct mmc_queue *mq = d;
@@ -62,18 +142,21 @@ static int mmc_queue_thread(void *d)
 
 		if (req || mq->mqrq_prev->req) {
 			set_current_state(TASK_RUNNING);
+			if (req)
+				mmc_queue_bkops_cancel(mq);
 		/* Abort any current bk ops of eMMC card by issuing HPI */
 			if (mmc_card_mmc(mq->card) && mmc_card_doing_bkops(mq->card)) {
-				mmc_interrupt_hpi(mq->card);
+				mmc_queue_bkops_interrupt(mq);
 			}
 			mq->issue_fn(mq, req);
 		} else {
 			/*
-			 * Since the queue is empty, start synchronous
-			 * background ops if there is a request for it.
+			 * Since the queue is empty, start background ops
+			 * if there is a request for it and the queue has
+			 * been idle long enough.
 			 */
 			if (mmc_card_need_bkops(mq->card))
-				mmc_bkops_start(mq->card, false, true);
+				mmc_queue_bkops_idle(mq);
 			if (kthread_should_stop()) {
 				set_current_state(TASK_RUNNING);
 				break;
@@ -188,6 +271,7 @@ int mmc_init_queue(struct mmc_queue *mq, struct mmc_card *card,
 
 	blk_queue_prep_rq(mq->queue, mmc_prep_request);
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, mq->queue);
+	mq->queue->backing_dev_info.lat_target_usec = MMC_QUEUE_READ_LAT_US;
 	if (mmc_can_erase(card))
 		mmc_queue_setup_discard(mq->queue, card);
 
@@ -267,6 +351,9 @@ int mmc_init_queue(struct mmc_queue *mq, struct mmc_card *card,
 
 	sema_init(&mq->thread_sem, 1);
 
+	mq->bkops_idle_ms = MMC_QUEUE_BKOPS_IDLE_MS;
+	INIT_DELAYED_WORK(&mq->bkops_work, mmc_queue_bkops_work);
+
 	mq->thread = kthread_run(mmc_queue_thread, mq, "mmcqd/%d%s",
 		host->index, subname ? subname : "");
 
@@ -307,8 +394,12 @@ void mmc_cleanup_queue(struct mmc_queue *mq)
 	/* Make sure the queue isn't suspended, as that will deadlock */
 	mmc_queue_resume(mq);
 
-	/* Then terminate our worker thread */
+	/* Then terminate our worker thread, which may still arm bkops_work */
+	spin_lock_irqsave(q->queue_lock, flags);
+	set_bit(MMC_QUEUE_BKOPS_OFF, &mq->bkops_flags);
+	spin_unlock_irqrestore(q->queue_lock, flags);
 	kthread_stop(mq->thread);
+	cancel_delayed_work_sync(&mq->bkops_work);
 
 	/* Empty the queue */
 	spin_lock_irqsave(q->queue_lock, flags);
@@ -354,11 +445,16 @@ void mmc_queue_suspend(struct mmc_queue *mq)
 	if (!(mq->flags & MMC_QUEUE_SUSPENDED)) {
 		mq->flags |= MMC_QUEUE_SUSPENDED;
 
+		/* No idle BKOPS across suspend, the host handles them */
 		spin_lock_irqsave(q->queue_lock, flags);
 		blk_stop_queue(q);
+		set_bit(MMC_QUEUE_BKOPS_OFF, &mq->bkops_flags);
 		spin_unlock_irqrestore(q->queue_lock, flags);
 
+		cancel_delayed_work_sync(&mq->bkops_work);
+
 		down(&mq->thread_sem);
+		clear_bit(MMC_QUEUE_BKOPS_DUE, &mq->bkops_flags);
 	}
 }
 
@@ -377,6 +473,7 @@ void mmc_queue_resume(struct mmc_queue *mq)
 		up(&mq->thread_sem);
 
 		spin_lock_irqsave(q->queue_lock, flags);
+		clear_bit(MMC_QUEUE_BKOPS_OFF, &mq->bkops_flags);
 		blk_start_queue(q);
 		spin_unlock_irqrestore(q->queue_lock, flags);
 	}
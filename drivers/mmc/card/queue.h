@@ -22,6 +22,13 @@ struct mmc_queue_req {
 	struct mmc_async_req	mmc_active;
 };
 
+struct mmc_bkops_stats {
+	unsigned int		started;	/* BKOPS started while idle */
+	unsigned int		deferred;	/* idle too short, not started */
+	unsigned int		hpi;		/* BKOPS interrupted for I/O */
+	u64			hpi_time_us;	/* time spent interrupting */
+};
+
 struct mmc_queue {
 	struct mmc_card		*card;
 	struct task_struct	*thread;
@@ -33,6 +40,12 @@ struct mmc_queue {
 	struct mmc_queue_req	mqrq[2];
 	struct mmc_queue_req	*mqrq_cur;
 	struct mmc_queue_req	*mqrq_prev;
+
+	/* Idle time background operations */
+	unsigned int		bkops_idle_ms;
+	unsigned long		bkops_flags;
+	struct delayed_work	bkops_work;
+	struct mmc_bkops_stats	bkops_stats;
 };
 
 extern int mmc_init_queue(struct mmc_queue *, struct mmc_card *, spinlock_t *,
@@ -866,6 +866,12 @@ struct ext4_inode_info {
 	 */
 	tid_t i_sync_tid;
 	tid_t i_datasync_tid;
+
+	/* last transaction that changed what a fast commit can't log */
+	tid_t i_fc_ineligible_tid;
+
+	/* stream of the last writer, for mb_stream_mode */
+	unsigned long i_mb_stream_key;
 };
 
 /*
@@ -917,6 +923,9 @@ struct ext4_inode_info {
 #define EXT4_MOUNT_DISCARD		0x40000000 /* Issue DISCARD requests */
 #define EXT4_MOUNT_INIT_INODE_TABLE	0x80000000 /* Initialize uninitialized itables */
 
+#define EXT4_MOUNT2_FAST_COMMIT		0x00000001 /* Log fsyncs in the fast
+						      commit area */
+
 #define clear_opt(sb, opt)		EXT4_SB(sb)->s_mount_opt &= \
 						~EXT4_MOUNT_##opt
 #define set_opt(sb, opt)		EXT4_SB(sb)->s_mount_opt |= \
@@ -1078,6 +1087,25 @@ struct ext4_super_block {
 #define EXT4_MF_MNTDIR_SAMPLED	0x0001
 #define EXT4_MF_FS_ABORTED	0x0002	/* Fatal error detected */
 
+/*
+ * Stream allocation cursors.  By default, all stream allocations go on
+ * from where the last one ended; mb_stream_mode gives each writing
+ * process or cgroup a cursor of its own.
+ */
+#define EXT4_MB_STREAM_GLOBAL	0
+#define EXT4_MB_STREAM_PROCESS	1
+#define EXT4_MB_STREAM_CGROUP	2
+
+#define EXT4_MB_STREAMS		16
+
+struct ext4_mb_stream {
+	unsigned long	ms_key;		/* 0: unused */
+	ext4_group_t	ms_group;
+	ext4_grpblk_t	ms_start;
+	unsigned long	ms_used;	/* jiffies of the last allocation */
+	unsigned long	ms_allocs;
+};
+
 /*
  * fourth extended-fs super-block data in memory
  */
@@ -1135,6 +1163,12 @@ struct ext4_sb_info {
 	u32 s_max_batch_time;
 	u32 s_min_batch_time;
 	struct block_device *journal_bdev;
+
+	/* Fast commits */
+	struct mutex s_fc_lock;
+	tid_t s_fc_tid;				/* transaction being logged */
+	unsigned int s_fc_off;			/* next block in the area */
+	tid_t s_fc_ineligible_tid;		/* no fast commits for this one */
 #ifdef CONFIG_JBD2_DEBUG
 	struct timer_list turn_ro_timer;	/* For turning read-only (crash simulation) */
 	wait_queue_head_t ro_wait_queue;	/* For people waiting for the fs to go read-only */
@@ -1178,6 +1212,11 @@ struct ext4_sb_info {
 	/* where last allocation was done - for stream allocation */
 	unsigned long s_mb_last_group;
 	unsigned long s_mb_last_start;
+	/* or, with s_mb_stream_mode, per writer: both under s_md_lock */
+	unsigned int s_mb_stream_mode;
+	struct ext4_mb_stream s_mb_streams[EXT4_MB_STREAMS];
+	unsigned long s_mb_stream_hits;	/* allocations from a cursor */
+	unsigned long s_mb_stream_new;	/* cursors started */
 
 	/* stats for buddy allocator */
 	atomic_t s_bal_reqs;	/* number of reqs with len > 1 */
@@ -1769,6 +1808,13 @@ extern int ext4_htree_store_dirent(struct file *dir_file, __u32 hash,
 				    struct ext4_dir_entry_2 *dirent);
 extern void ext4_htree_free_dir_info(struct dir_private_info *p);
 
+/* fast_commit.c */
+extern int ext4_fc_init(struct super_block *sb);
+extern void ext4_fc_release(struct super_block *sb);
+extern int ext4_fc_replay(journal_t *journal, struct buffer_head *bh,
+			  unsigned int off, tid_t tid);
+extern int ext4_fc_commit(struct inode *inode, tid_t commit_tid);
+
 /* fsync.c */
 extern int ext4_sync_file(struct file *, loff_t, loff_t, int);
 extern int ext4_flush_completed_IO(struct inode *);
@@ -1808,6 +1854,7 @@ extern int ext4_mb_add_groupinfo(struct super_block *sb,
 extern int ext4_group_add_blocks(handle_t *handle, struct super_block *sb,
 				ext4_fsblk_t block, unsigned long count);
 extern int ext4_trim_fs(struct super_block *, struct fstrim_range *);
+extern unsigned long ext4_mb_stream_key(struct super_block *sb);
 
 /* inode.c */
 struct buffer_head *ext4_getblk(handle_t *, struct inode *,
@@ -2082,6 +2129,8 @@ struct ext4_group_info {
 	ext4_grpblk_t	bb_free;	/* total free blocks */
 	ext4_grpblk_t	bb_fragments;	/* nr of freespace fragments */
 	ext4_grpblk_t	bb_largest_free_order;/* order of largest frag in BG */
+	atomic_t	bb_data_allocs;	/* data extents allocated here */
+	atomic_t	bb_data_splits;	/* ...not following their file */
 	struct          list_head bb_prealloc_list;
 #ifdef DOUBLE_CHECK
 	void            *bb_bitmap;
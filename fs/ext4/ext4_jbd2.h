@@ -258,6 +258,28 @@ static inline void ext4_update_inode_fsync_trans(handle_t *handle,
 	}
 }
 
+/*
+ * Called before a change to @inode that a fast commit can't log, such as
+ * freeing blocks or changing a directory: fsync then has to commit the
+ * transaction the change is in.
+ */
+static inline void ext4_fc_mark_ineligible(handle_t *handle,
+					   struct inode *inode)
+{
+	if (ext4_handle_valid(handle))
+		EXT4_I(inode)->i_fc_ineligible_tid =
+			handle->h_transaction->t_tid;
+}
+
+/* The same for a change that concerns the whole filesystem */
+static inline void ext4_fc_mark_fs_ineligible(handle_t *handle,
+					      struct super_block *sb)
+{
+	if (ext4_handle_valid(handle))
+		EXT4_SB(sb)->s_fc_ineligible_tid =
+			handle->h_transaction->t_tid;
+}
+
 /* super.c */
 int ext4_force_commit(struct super_block *sb);
 
@@ -4206,6 +4206,9 @@ int ext4_ext_punch_hole(struct file *file, loff_t offset, loff_t length)
 	if (IS_ERR(handle))
 		return PTR_ERR(handle);
 
+	/* the extents removed here can't be described by an inode image */
+	ext4_fc_mark_ineligible(handle, inode);
+
 	err = ext4_orphan_add(handle, inode);
 	if (err)
 		goto out;
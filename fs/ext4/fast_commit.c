@@ -0,0 +1,396 @@
+/*
+ *  linux/fs/ext4/fast_commit.c
+ *
+ * Fast commits: an fsync of a file whose changes since the last commit are
+ * confined to its own inode, plus the blocks allocated to it, writes that
+ * inode to a block of the fast commit area at the end of the journal
+ * instead of committing the whole running transaction.
+ *
+ * The files that qualify are regular files in data=ordered mode whose
+ * extents all fit in the inode, which covers the fsync pattern of database
+ * logs: appends and rewrites of a file that is kept open.  Anything else,
+ * or any change that touched other metadata on the file's behalf (see
+ * ext4_fc_mark_ineligible()), falls back to a full commit.
+ *
+ * Each record is a copy of the on-disk inode, tagged with the transaction
+ * that was running.  After the log has been replayed, recovery hands the
+ * area back: records of the transaction that didn't make it into the log
+ * are written to the inode table, and the blocks of their extents are
+ * marked in use.  Once that transaction commits, they are left alone.
+ */
+
+#include <linux/fs.h>
+#include <linux/jbd2.h>
+#include <linux/buffer_head.h>
+#include <linux/pagemap.h>
+#include <linux/slab.h>
+#include <linux/quotaops.h>
+#include <linux/crc32.h>
+#include "ext4.h"
+#include "ext4_jbd2.h"
+#include "ext4_extents.h"
+
+#define EXT4_FC_MAGIC		0xE4FC0001
+#define EXT4_FC_BLOCKS		256	/* size of the fast commit area */
+
+/* Header of a fast commit block, followed by the raw inode */
+struct ext4_fc_block {
+	__le32	fb_magic;
+	__le32	fb_tid;		/* transaction that was running */
+	__le32	fb_ino;
+	__le16	fb_inode_size;
+	__le16	fb_reserved;
+	__le32	fb_checksum;	/* crc32 of the block, with this field 0 */
+};
+
+static __u32 ext4_fc_csum(struct ext4_fc_block *fb, unsigned int size)
+{
+	__le32 saved = fb->fb_checksum;
+	__u32 csum;
+
+	fb->fb_checksum = 0;
+	csum = crc32_le(~0, (unsigned char *)fb, size);
+	fb->fb_checksum = saved;
+	return csum;
+}
+
+/*
+ * Set up the fast commit area when the filesystem goes read-write, while
+ * the journal is still empty.  Without one, fast_commit is turned off
+ * again.
+ */
+int ext4_fc_init(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	journal_t *journal = sbi->s_journal;
+	int err;
+
+	if (test_opt(sb, DATA_FLAGS) != EXT4_MOUNT_ORDERED_DATA) {
+		ext4_msg(sb, KERN_WARNING,
+			 "fast_commit needs data=ordered, disabled");
+		goto disable;
+	}
+	if (sizeof(struct ext4_fc_block) + EXT4_INODE_SIZE(sb) >
+	    sb->s_blocksize)
+		goto disable;
+
+	err = jbd2_fc_init(journal, EXT4_FC_BLOCKS);
+	if (err) {
+		ext4_msg(sb, KERN_WARNING, "can't set up a fast commit area "
+			 "in the journal (%d), fast_commit disabled", err);
+		goto disable;
+	}
+
+	sbi->s_fc_tid = journal->j_commit_sequence;
+	sbi->s_fc_ineligible_tid = journal->j_commit_sequence;
+	return 0;
+
+disable:
+	clear_opt2(sb, FAST_COMMIT);
+	return -EINVAL;
+}
+
+/*
+ * Read-write without fast_commit: drop the fast commit area a previous
+ * mount left in the journal, if there is one, so that tools which don't
+ * know the feature can use the journal again.
+ */
+void ext4_fc_release(struct super_block *sb)
+{
+	int err;
+
+	err = jbd2_fc_release(EXT4_SB(sb)->s_journal);
+	if (err)
+		ext4_msg(sb, KERN_WARNING, "can't drop the fast commit area "
+			 "of the journal (%d)", err);
+}
+
+/*
+ * Mark the blocks of an extent in use in the block bitmaps, and take
+ * those that were free off the group's free count.
+ */
+static int ext4_fc_mark_used(struct super_block *sb, ext4_fsblk_t block,
+			     unsigned int count)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_group_desc *gdp;
+	struct buffer_head *gd_bh, *bitmap_bh;
+	ext4_group_t group;
+	ext4_grpblk_t bit;
+	unsigned int i, n, newly;
+
+	while (count) {
+		ext4_get_group_no_and_offset(sb, block, &group, &bit);
+		n = min_t(unsigned int, count,
+			  EXT4_BLOCKS_PER_GROUP(sb) - bit);
+
+		gdp = ext4_get_group_desc(sb, group, &gd_bh);
+		if (!gdp)
+			return -EIO;
+		/* the transaction that initialized it is in the log */
+		if (gdp->bg_flags & cpu_to_le16(EXT4_BG_BLOCK_UNINIT))
+			return -EIO;
+		bitmap_bh = sb_bread(sb, ext4_block_bitmap(sb, gdp));
+		if (!bitmap_bh)
+			return -EIO;
+
+		newly = 0;
+		for (i = 0; i < n; i++)
+			if (!ext4_set_bit(bit + i, bitmap_bh->b_data))
+				newly++;
+		if (newly) {
+			mark_buffer_dirty(bitmap_bh);
+			ext4_free_blks_set(sb, gdp,
+					   ext4_free_blks_count(sb, gdp) - newly);
+			gdp->bg_checksum = ext4_group_desc_csum(sbi, group, gdp);
+			mark_buffer_dirty(gd_bh);
+		}
+		brelse(bitmap_bh);
+
+		block += n;
+		count -= n;
+	}
+	return 0;
+}
+
+static int ext4_fc_replay_inode(struct super_block *sb, unsigned long ino,
+				struct ext4_inode *raw)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_extent_header *eh;
+	struct ext4_extent *ex;
+	struct ext4_group_desc *gdp;
+	struct buffer_head *bh;
+	ext4_fsblk_t block;
+	unsigned long offset;
+	int i, err;
+
+	eh = (struct ext4_extent_header *)raw->i_block;
+	if (!(le32_to_cpu(raw->i_flags) & EXT4_EXTENTS_FL) ||
+	    eh->eh_magic != EXT4_EXT_MAGIC || eh->eh_depth ||
+	    le16_to_cpu(eh->eh_entries) > le16_to_cpu(eh->eh_max) ||
+	    le16_to_cpu(eh->eh_max) > 4)
+		return -EIO;
+
+	ex = EXT_FIRST_EXTENT(eh);
+	for (i = 0; i < le16_to_cpu(eh->eh_entries); i++, ex++) {
+		block = ext4_ext_pblock(ex);
+		if (!ext4_data_block_valid(sbi, block,
+					   ext4_ext_get_actual_len(ex)))
+			return -EIO;
+		err = ext4_fc_mark_used(sb, block,
+					ext4_ext_get_actual_len(ex));
+		if (err)
+			return err;
+	}
+
+	gdp = ext4_get_group_desc(sb, (ino - 1) / EXT4_INODES_PER_GROUP(sb),
+				  NULL);
+	if (!gdp)
+		return -EIO;
+	offset = ((ino - 1) % EXT4_INODES_PER_GROUP(sb)) * EXT4_INODE_SIZE(sb);
+	block = ext4_inode_table(sb, gdp) + (offset >> EXT4_BLOCK_SIZE_BITS(sb));
+	offset &= sb->s_blocksize - 1;
+
+	bh = sb_bread(sb, block);
+	if (!bh)
+		return -EIO;
+	memcpy(bh->b_data + offset, raw, EXT4_INODE_SIZE(sb));
+	mark_buffer_dirty(bh);
+	brelse(bh);
+	return 0;
+}
+
+/*
+ * The journal's j_fc_replay_callback.  Recovery syncs the filesystem
+ * device afterwards.
+ */
+int ext4_fc_replay(journal_t *journal, struct buffer_head *bh,
+		   unsigned int off, tid_t tid)
+{
+	struct super_block *sb = journal->j_private;
+	struct ext4_fc_block *fb = (struct ext4_fc_block *)bh->b_data;
+	unsigned long ino;
+	int err;
+
+	/* the first block not written for @tid ends the records */
+	if (le32_to_cpu(fb->fb_magic) != EXT4_FC_MAGIC ||
+	    le32_to_cpu(fb->fb_tid) != tid ||
+	    le32_to_cpu(fb->fb_checksum) !=
+	    ext4_fc_csum(fb, journal->j_blocksize))
+		return 1;
+
+	ino = le32_to_cpu(fb->fb_ino);
+	if (ino < EXT4_FIRST_INO(sb) ||
+	    ino > le32_to_cpu(EXT4_SB(sb)->s_es->s_inodes_count) ||
+	    le16_to_cpu(fb->fb_inode_size) != EXT4_INODE_SIZE(sb)) {
+		err = -EIO;
+		goto out;
+	}
+
+	err = ext4_fc_replay_inode(sb, ino, (struct ext4_inode *)(fb + 1));
+out:
+	if (err)
+		ext4_msg(sb, KERN_ERR, "fast commit %u of inode %lu "
+			 "is corrupt", off, ino);
+	else
+		jbd_debug(1, "ext4: replayed fast commit %u of inode %lu\n",
+			  off, ino);
+	return err;
+}
+
+static int ext4_fc_eligible(struct inode *inode)
+{
+	struct super_block *sb = inode->i_sb;
+
+	if (!S_ISREG(inode->i_mode) ||
+	    !ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS) ||
+	    !ext4_should_order_data(inode))
+		return 0;
+	/* on the orphan list, it is linked from the superblock */
+	if (!list_empty(&EXT4_I(inode)->i_orphan))
+		return 0;
+	/* quota updates go to the quota files */
+	if (sb_any_quota_loaded(sb))
+		return 0;
+	return 1;
+}
+
+/*
+ * Wait for the committing transaction, which may hold earlier changes to
+ * the inode, and return the running one if that is @commit_tid.
+ */
+static int ext4_fc_running_tid(journal_t *journal, tid_t commit_tid,
+			       tid_t *tid)
+{
+	tid_t committing;
+
+	for (;;) {
+		read_lock(&journal->j_state_lock);
+		if (!journal->j_committing_transaction)
+			break;
+		committing = journal->j_committing_transaction->t_tid;
+		read_unlock(&journal->j_state_lock);
+		if (committing == commit_tid)
+			return -EAGAIN;
+		jbd2_log_wait_commit(journal, committing);
+	}
+
+	/*
+	 * After a flush the log is empty on disk and recovery won't look at
+	 * the fast commit area, until the next commit rewrites the superblock.
+	 */
+	if (!journal->j_running_transaction ||
+	    journal->j_running_transaction->t_tid != commit_tid ||
+	    (journal->j_flags & (JBD2_FLUSHED | JBD2_ABORT))) {
+		read_unlock(&journal->j_state_lock);
+		return -EAGAIN;
+	}
+	*tid = commit_tid;
+	read_unlock(&journal->j_state_lock);
+	return 0;
+}
+
+/**
+ * ext4_fc_commit - write an inode to the fast commit area
+ * @inode:	inode being synced, with its data written out
+ * @commit_tid:	transaction that holds its last change
+ *
+ * Returns 0 once @inode is on stable storage, or -EAGAIN if the caller
+ * has to commit the journal instead.
+ */
+int ext4_fc_commit(struct inode *inode, tid_t commit_tid)
+{
+	struct super_block *sb = inode->i_sb;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	journal_t *journal = sbi->s_journal;
+	struct ext4_extent_header *eh;
+	struct ext4_fc_block *fb;
+	struct ext4_inode *raw;
+	struct ext4_iloc iloc;
+	struct buffer_head *bh;
+	tid_t tid;
+	int err;
+
+	if (journal->j_fc_first == journal->j_fc_last ||
+	    !ext4_fc_eligible(inode))
+		return -EAGAIN;
+
+	err = ext4_fc_running_tid(journal, commit_tid, &tid);
+	if (err)
+		return err;
+
+	raw = kmalloc(EXT4_INODE_SIZE(sb), GFP_NOFS);
+	if (!raw)
+		return -EAGAIN;
+	err = ext4_get_inode_loc(inode, &iloc);
+	if (err)
+		goto out_free;
+	/* extent changes update the raw inode under i_data_sem */
+	down_read(&ei->i_data_sem);
+	memcpy(raw, ext4_raw_inode(&iloc), EXT4_INODE_SIZE(sb));
+	up_read(&ei->i_data_sem);
+	brelse(iloc.bh);
+
+	/* only extents that fit in the inode are logged */
+	err = -EAGAIN;
+	eh = (struct ext4_extent_header *)raw->i_block;
+	if (eh->eh_magic != EXT4_EXT_MAGIC || eh->eh_depth)
+		goto out_free;
+
+	/*
+	 * Blocks in the copy may have been allocated by writeback of other
+	 * ranges, or of mmapped pages: their data has to be on disk before
+	 * the record is.
+	 */
+	err = filemap_write_and_wait(inode->i_mapping);
+	if (err)
+		goto out_free;
+
+	mutex_lock(&sbi->s_fc_lock);
+	/*
+	 * Changes that rule out a fast commit are marked before they are
+	 * made, so this catches all those that made it into the copy.
+	 */
+	err = -EAGAIN;
+	if (tid_geq(ei->i_fc_ineligible_tid, tid) ||
+	    tid_geq(sbi->s_fc_ineligible_tid, tid))
+		goto out;
+
+	/*
+	 * The records of a transaction are only dropped once it has
+	 * committed.  One that is already past is committing now.
+	 */
+	if (tid_gt(sbi->s_fc_tid, tid))
+		goto out;
+	if (sbi->s_fc_tid != tid) {
+		sbi->s_fc_tid = tid;
+		sbi->s_fc_off = 0;
+	}
+	bh = jbd2_fc_get_buf(journal, sbi->s_fc_off);
+	if (!bh)
+		goto out;
+
+	lock_buffer(bh);
+	memset(bh->b_data, 0, bh->b_size);
+	fb = (struct ext4_fc_block *)bh->b_data;
+	fb->fb_magic = cpu_to_le32(EXT4_FC_MAGIC);
+	fb->fb_tid = cpu_to_le32(tid);
+	fb->fb_ino = cpu_to_le32(inode->i_ino);
+	fb->fb_inode_size = cpu_to_le16(EXT4_INODE_SIZE(sb));
+	memcpy(fb + 1, raw, EXT4_INODE_SIZE(sb));
+	fb->fb_checksum = cpu_to_le32(ext4_fc_csum(fb, bh->b_size));
+	unlock_buffer(bh);
+
+	if (!jbd2_fc_write_buf(journal, bh)) {
+		sbi->s_fc_off++;
+		err = 0;
+	}
+	brelse(bh);
+out:
+	mutex_unlock(&sbi->s_fc_lock);
+out_free:
+	kfree(raw);
+	return err;
+}
@@ -119,6 +119,10 @@ ext4_file_write(struct kiocb *iocb, const struct iovec *iov,
 		unaligned_aio = ext4_unaligned_aio(inode, iov, nr_segs, pos);
 	}
 
+	/* delayed allocation happens in the flusher, remember the writer */
+	if (EXT4_SB(inode->i_sb)->s_mb_stream_mode)
+		EXT4_I(inode)->i_mb_stream_key = ext4_mb_stream_key(inode->i_sb);
+
 	/* Unaligned direct AIO must be serialized; see comment above */
 	if (unaligned_aio) {
 		static unsigned long unaligned_warn_time;
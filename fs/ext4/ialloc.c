@@ -954,6 +954,7 @@ got:
 		ext4_lock_group(sb, group);
 		/* recheck and clear flag under lock if we still need to */
 		if (gdp->bg_flags & cpu_to_le16(EXT4_BG_BLOCK_UNINIT)) {
+			ext4_fc_mark_fs_ineligible(handle, sb);
 			free = ext4_free_blocks_after_init(sb, group, gdp);
 			gdp->bg_flags &= cpu_to_le16(~EXT4_BG_BLOCK_UNINIT);
 			ext4_free_blks_set(sb, gdp, free);
@@ -1030,6 +1031,8 @@ got:
 
 	ext4_clear_state_flags(ei); /* Only relevant on 32-bit archs */
 	ext4_set_inode_state(inode, EXT4_STATE_NEW);
+	/* its directory entry isn't in the inode */
+	ext4_fc_mark_ineligible(handle, inode);
 
 	ei->i_extra_isize = EXT4_SB(sb)->s_want_extra_isize;
 
@@ -1518,6 +1518,133 @@ static int mb_mark_used(struct ext4_buddy *e4b, struct ext4_free_extent *ex)
 	return ret;
 }
 
+/*
+ * The stream a write belongs to with mb_stream_mode set: its process, or
+ * the set of cgroups it runs in.  0 selects the global cursor.
+ */
+unsigned long ext4_mb_stream_key(struct super_block *sb)
+{
+	switch (EXT4_SB(sb)->s_mb_stream_mode) {
+	case EXT4_MB_STREAM_CGROUP:
+#ifdef CONFIG_CGROUPS
+		/* only ever compared, never dereferenced */
+		return (unsigned long)rcu_access_pointer(current->cgroups);
+#endif
+		/* fall through */
+	case EXT4_MB_STREAM_PROCESS:
+		return current->tgid;
+	}
+	return 0;
+}
+
+/*
+ * With mb_stream_mode, each stream has a cursor of its own, so that the
+ * files of concurrent writers don't take turns in the same free extents.
+ * The least recently used cursor is recycled for a new stream.  These
+ * are called with s_md_lock held.
+ */
+static struct ext4_mb_stream *
+ext4_mb_stream_find(struct ext4_sb_info *sbi, unsigned long key)
+{
+	int i;
+
+	for (i = 0; i < EXT4_MB_STREAMS; i++)
+		if (sbi->s_mb_streams[i].ms_key == key)
+			return &sbi->s_mb_streams[i];
+	return NULL;
+}
+
+static int ext4_mb_stream_in_group(struct ext4_sb_info *sbi,
+				   ext4_group_t group)
+{
+	int i;
+
+	for (i = 0; i < EXT4_MB_STREAMS; i++)
+		if (sbi->s_mb_streams[i].ms_key &&
+		    sbi->s_mb_streams[i].ms_group == group)
+			return 1;
+	return 0;
+}
+
+static struct ext4_mb_stream *ext4_mb_stream_victim(struct ext4_sb_info *sbi)
+{
+	struct ext4_mb_stream *ms, *lru = &sbi->s_mb_streams[0];
+	int i;
+
+	for (i = 0; i < EXT4_MB_STREAMS; i++) {
+		ms = &sbi->s_mb_streams[i];
+		if (!ms->ms_key)
+			return ms;
+		if (time_before(ms->ms_used, lru->ms_used))
+			lru = ms;
+	}
+	return lru;
+}
+
+static void ext4_mb_stream_goal(struct ext4_allocation_context *ac,
+				ext4_group_t ngroups)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(ac->ac_sb);
+	struct ext4_mb_stream *ms;
+	ext4_group_t group;
+	int i;
+
+	spin_lock(&sbi->s_md_lock);
+	ms = ext4_mb_stream_find(sbi, ac->ac_stream_key);
+	if (ms && ms->ms_group < ngroups) {
+		ac->ac_g_ex.fe_group = ms->ms_group;
+		ac->ac_g_ex.fe_start = ms->ms_start;
+		sbi->s_mb_stream_hits++;
+		goto out;
+	}
+
+	/*
+	 * A new stream starts from the goal of its inode, unless another
+	 * stream is already writing into that group: then from the next
+	 * group without one.
+	 */
+	group = ac->ac_g_ex.fe_group;
+	for (i = 0; i < EXT4_MB_STREAMS &&
+		    ext4_mb_stream_in_group(sbi, group); i++) {
+		if (++group >= ngroups)
+			group = 0;
+	}
+	if (group != ac->ac_g_ex.fe_group) {
+		ac->ac_g_ex.fe_group = group;
+		ac->ac_g_ex.fe_start = 0;
+	}
+
+	if (!ms)
+		ms = ext4_mb_stream_victim(sbi);
+	ms->ms_key = ac->ac_stream_key;
+	ms->ms_group = group;
+	ms->ms_start = ac->ac_g_ex.fe_start;
+	ms->ms_used = jiffies;
+	ms->ms_allocs = 0;
+	sbi->s_mb_stream_new++;
+out:
+	spin_unlock(&sbi->s_md_lock);
+}
+
+static void ext4_mb_stream_update(struct ext4_sb_info *sbi,
+				  struct ext4_allocation_context *ac)
+{
+	struct ext4_mb_stream *ms;
+
+	ms = ext4_mb_stream_find(sbi, ac->ac_stream_key);
+	if (!ms) {
+		/* recycled meanwhile, or the goal was found right away */
+		ms = ext4_mb_stream_victim(sbi);
+		ms->ms_key = ac->ac_stream_key;
+		ms->ms_allocs = 0;
+		sbi->s_mb_stream_new++;
+	}
+	ms->ms_group = ac->ac_f_ex.fe_group;
+	ms->ms_start = ac->ac_f_ex.fe_start;
+	ms->ms_used = jiffies;
+	ms->ms_allocs++;
+}
+
 /*
  * Must be called under group lock!
  */
@@ -1556,8 +1683,12 @@ static void ext4_mb_use_best_found(struct ext4_allocation_context *ac,
 	/* store last allocated for subsequent stream allocation */
 	if (ac->ac_flags & EXT4_MB_STREAM_ALLOC) {
 		spin_lock(&sbi->s_md_lock);
-		sbi->s_mb_last_group = ac->ac_f_ex.fe_group;
-		sbi->s_mb_last_start = ac->ac_f_ex.fe_start;
+		if (ac->ac_stream_key) {
+			ext4_mb_stream_update(sbi, ac);
+		} else {
+			sbi->s_mb_last_group = ac->ac_f_ex.fe_group;
+			sbi->s_mb_last_start = ac->ac_f_ex.fe_start;
+		}
 		spin_unlock(&sbi->s_md_lock);
 	}
 }
@@ -2004,7 +2135,9 @@ ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 	}
 
 	/* if stream allocation is enabled, use global goal */
-	if (ac->ac_flags & EXT4_MB_STREAM_ALLOC) {
+	if (ac->ac_flags & EXT4_MB_STREAM_ALLOC && ac->ac_stream_key) {
+		ext4_mb_stream_goal(ac, ngroups);
+	} else if (ac->ac_flags & EXT4_MB_STREAM_ALLOC) {
 		/* TBD: may be hot point */
 		spin_lock(&sbi->s_md_lock);
 		ac->ac_g_ex.fe_group = sbi->s_mb_last_group;
@@ -2196,6 +2329,119 @@ static const struct file_operations ext4_mb_seq_groups_fops = {
 	.release	= seq_release,
 };
 
+/*
+ * mb_frag: free space fragmentation of each group, and how many of the
+ * data extents allocated in it could not continue their file.
+ */
+static int ext4_mb_seq_frag_show(struct seq_file *seq, void *v)
+{
+	struct super_block *sb = seq->private;
+	ext4_group_t group = (ext4_group_t) ((unsigned long) v);
+	struct ext4_group_info *grp;
+	struct ext4_buddy e4b;
+	ext4_grpblk_t free, frags, order;
+	int err;
+
+	group--;
+	if (group == 0)
+		seq_printf(seq, "#%-5s: %-5s %-5s %-5s %-5s %-8s %-8s\n",
+			   "group", "free", "frags", "avg", "order",
+			   "allocs", "splits");
+
+	err = ext4_mb_load_buddy(sb, group, &e4b);
+	if (err) {
+		seq_printf(seq, "#%-5u: I/O error\n", group);
+		return 0;
+	}
+	grp = ext4_get_group_info(sb, group);
+	ext4_lock_group(sb, group);
+	free = grp->bb_free;
+	frags = grp->bb_fragments;
+	order = grp->bb_largest_free_order;
+	ext4_unlock_group(sb, group);
+	ext4_mb_unload_buddy(&e4b);
+
+	seq_printf(seq, "#%-5u: %-5u %-5u %-5u %-5d %-8u %-8u\n", group,
+		   free, frags, frags ? free / frags : 0, order,
+		   atomic_read(&grp->bb_data_allocs),
+		   atomic_read(&grp->bb_data_splits));
+
+	return 0;
+}
+
+static const struct seq_operations ext4_mb_seq_frag_ops = {
+	.start  = ext4_mb_seq_groups_start,
+	.next   = ext4_mb_seq_groups_next,
+	.stop   = ext4_mb_seq_groups_stop,
+	.show   = ext4_mb_seq_frag_show,
+};
+
+static int ext4_mb_seq_frag_open(struct inode *inode, struct file *file)
+{
+	struct super_block *sb = PDE(inode)->data;
+	int rc;
+
+	rc = seq_open(file, &ext4_mb_seq_frag_ops);
+	if (rc == 0) {
+		struct seq_file *m = file->private_data;
+		m->private = sb;
+	}
+	return rc;
+}
+
+static const struct file_operations ext4_mb_seq_frag_fops = {
+	.owner		= THIS_MODULE,
+	.open		= ext4_mb_seq_frag_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= seq_release,
+};
+
+/* mb_streams: the stream allocation cursors */
+static int ext4_mb_streams_show(struct seq_file *seq, void *v)
+{
+	struct super_block *sb = seq->private;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_mb_stream streams[EXT4_MB_STREAMS];
+	unsigned long hits, started;
+	int i;
+
+	spin_lock(&sbi->s_md_lock);
+	memcpy(streams, sbi->s_mb_streams, sizeof(streams));
+	hits = sbi->s_mb_stream_hits;
+	started = sbi->s_mb_stream_new;
+	spin_unlock(&sbi->s_md_lock);
+
+	seq_printf(seq, "mode: %u\n", sbi->s_mb_stream_mode);
+	seq_printf(seq, "stream_hits: %lu\n", hits);
+	seq_printf(seq, "streams_started: %lu\n", started);
+	for (i = 0; i < EXT4_MB_STREAMS; i++) {
+		struct ext4_mb_stream *ms = &streams[i];
+
+		if (!ms->ms_key)
+			continue;
+		seq_printf(seq, "%lx: group %u start %u allocs %lu "
+			   "idle_ms %u\n", ms->ms_key, ms->ms_group,
+			   ms->ms_start, ms->ms_allocs,
+			   jiffies_to_msecs(jiffies - ms->ms_used));
+	}
+
+	return 0;
+}
+
+static int ext4_mb_streams_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ext4_mb_streams_show, PDE(inode)->data);
+}
+
+static const struct file_operations ext4_mb_streams_fops = {
+	.owner		= THIS_MODULE,
+	.open		= ext4_mb_streams_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static struct kmem_cache *get_groupinfo_cache(int blocksize_bits)
 {
 	int cache_index = blocksize_bits - EXT4_MIN_BLOCK_LOG_SIZE;
@@ -2507,9 +2753,14 @@ int ext4_mb_init(struct super_block *sb, int needs_recovery)
 		goto out;
 	}
 
-	if (sbi->s_proc)
+	if (sbi->s_proc) {
 		proc_create_data("mb_groups", S_IRUGO, sbi->s_proc,
 				 &ext4_mb_seq_groups_fops, sb);
+		proc_create_data("mb_frag", S_IRUGO, sbi->s_proc,
+				 &ext4_mb_seq_frag_fops, sb);
+		proc_create_data("mb_streams", S_IRUGO, sbi->s_proc,
+				 &ext4_mb_streams_fops, sb);
+	}
 
 	if (sbi->s_journal)
 		sbi->s_journal->j_commit_callback = release_blocks_on_commit;
@@ -2595,8 +2846,11 @@ int ext4_mb_release(struct super_block *sb)
 	}
 
 	free_percpu(sbi->s_locality_groups);
-	if (sbi->s_proc)
+	if (sbi->s_proc) {
+		remove_proc_entry("mb_streams", sbi->s_proc);
+		remove_proc_entry("mb_frag", sbi->s_proc);
 		remove_proc_entry("mb_groups", sbi->s_proc);
+	}
 
 	return 0;
 }
@@ -2822,6 +3076,7 @@ ext4_mb_mark_diskspace_used(struct ext4_allocation_context *ac,
 	ext4_set_bits(bitmap_bh->b_data, ac->ac_b_ex.fe_start,
 		      ac->ac_b_ex.fe_len);
 	if (gdp->bg_flags & cpu_to_le16(EXT4_BG_BLOCK_UNINIT)) {
+		ext4_fc_mark_fs_ineligible(handle, sb);
 		gdp->bg_flags &= cpu_to_le16(~EXT4_BG_BLOCK_UNINIT);
 		ext4_free_blks_set(sb, gdp,
 					ext4_free_blocks_after_init(sb,
@@ -3973,6 +4228,12 @@ static void ext4_mb_group_or_file(struct ext4_allocation_context *ac)
 	size = max(size, isize);
 	if (size > sbi->s_mb_stream_request) {
 		ac->ac_flags |= EXT4_MB_STREAM_ALLOC;
+		if (sbi->s_mb_stream_mode) {
+			ac->ac_stream_key =
+				EXT4_I(ac->ac_inode)->i_mb_stream_key;
+			if (!ac->ac_stream_key)
+				ac->ac_stream_key = ext4_mb_stream_key(ac->ac_sb);
+		}
 		return;
 	}
 
@@ -4235,6 +4496,24 @@ static int ext4_mb_discard_preallocations(struct super_block *sb, int needed)
 	return freed;
 }
 
+/* the per group counters shown in mb_frag */
+static void ext4_mb_count_data_alloc(struct ext4_allocation_context *ac,
+				     struct ext4_allocation_request *ar,
+				     ext4_fsblk_t block)
+{
+	struct ext4_group_info *grp;
+
+	if (!(ac->ac_flags & EXT4_MB_HINT_DATA))
+		return;
+
+	grp = ext4_get_group_info(ac->ac_sb, ac->ac_b_ex.fe_group);
+	atomic_inc(&grp->bb_data_allocs);
+	/* it could have continued its left neighbour, but doesn't */
+	if (ar->pleft && ar->lleft + 1 == ar->logical &&
+	    ar->pleft + 1 != block)
+		atomic_inc(&grp->bb_data_splits);
+}
+
 /*
  * Main entry point into mballoc to allocate blocks
  * it tries to use preallocation first, then falls back
@@ -4346,6 +4625,7 @@ repeat:
 		else {
 			block = ext4_grp_offs_to_block(sb, &ac->ac_b_ex);
 			ar->len = ac->ac_b_ex.fe_len;
+			ext4_mb_count_data_alloc(ac, ar, block);
 		}
 	} else {
 		freed  = ext4_mb_discard_preallocations(sb, ac->ac_o_ex.fe_len);
@@ -4607,11 +4887,16 @@ do_more:
 	if (err)
 		goto error_return;
 
-	if ((flags & EXT4_FREE_BLOCKS_METADATA) && ext4_handle_valid(handle)) {
+	if (((flags & EXT4_FREE_BLOCKS_METADATA) ||
+	     test_opt2(sb, FAST_COMMIT)) && ext4_handle_valid(handle)) {
 		struct ext4_free_data *new_entry;
 		/*
 		 * blocks being freed are metadata. these blocks shouldn't
-		 * be used until this transaction is committed
+		 * be used until this transaction is committed.  With
+		 * fast_commit, neither should data blocks: a fast commit
+		 * record of the file they go to next would be replayed on
+		 * top of the transaction that frees them, which a crash can
+		 * lose.
 		 */
 		new_entry = kmem_cache_alloc(ext4_free_ext_cachep, GFP_NOFS);
 		if (!new_entry) {
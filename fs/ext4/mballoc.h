@@ -194,6 +194,7 @@ struct ext4_allocation_context {
 	struct page *ac_buddy_page;
 	struct ext4_prealloc_space *ac_pa;
 	struct ext4_locality_group *ac_lg;
+	unsigned long ac_stream_key;	/* 0: the global stream cursor */
 };
 
 #define AC_STATUS_CONTINUE	1
@@ -345,6 +345,9 @@ static int ext4_ext_swap_inode_data(handle_t *handle, struct inode *inode,
 	struct ext4_inode_info *ei = EXT4_I(inode);
 	struct ext4_inode_info *tmp_ei = EXT4_I(tmp_inode);
 
+	/* the indirect blocks are freed */
+	ext4_fc_mark_ineligible(handle, inode);
+
 	/*
 	 * One credit accounted for writing the
 	 * i_data field of the original inode
@@ -1985,6 +1985,8 @@ int ext4_orphan_add(handle_t *handle, struct inode *inode)
 	mutex_lock(&EXT4_SB(sb)->s_orphan_lock);
 	if (!list_empty(&EXT4_I(inode)->i_orphan))
 		goto out_unlock;
+	/* the blocks freed on the way out of the list aren't logged */
+	ext4_fc_mark_ineligible(handle, inode);
 
 	/*
 	 * Orphan handling is only valid for files with data blocks
@@ -2060,6 +2062,7 @@ int ext4_orphan_del(handle_t *handle, struct inode *inode)
 	mutex_lock(&EXT4_SB(inode->i_sb)->s_orphan_lock);
 	if (list_empty(&ei->i_orphan))
 		goto out;
+	ext4_fc_mark_ineligible(handle, inode);
 
 	ino_next = NEXT_ORPHAN(inode);
 	prev = ei->i_orphan.prev;
@@ -2209,6 +2212,7 @@ static int ext4_unlink(struct inode *dir, struct dentry *dentry)
 	retval = -EIO;
 	if (le32_to_cpu(de->inode) != inode->i_ino)
 		goto end_unlink;
+	ext4_fc_mark_ineligible(handle, inode);
 
 	if (!inode->i_nlink) {
 		ext4_warning(inode->i_sb,
@@ -2364,6 +2368,7 @@ retry:
 	if (IS_DIRSYNC(dir))
 		ext4_handle_sync(handle);
 
+	ext4_fc_mark_ineligible(handle, inode);
 	inode->i_ctime = ext4_current_time(inode);
 	ext4_inc_count(handle, inode);
 	ihold(inode);
@@ -2429,6 +2434,9 @@ static int ext4_rename(struct inode *old_dir, struct dentry *old_dentry,
 		goto end_rename;
 
 	new_inode = new_dentry->d_inode;
+	ext4_fc_mark_ineligible(handle, old_inode);
+	if (new_inode)
+		ext4_fc_mark_ineligible(handle, new_inode);
 	new_bh = ext4_find_entry(new_dir, &new_dentry->d_name, &new_de);
 	if (new_bh) {
 		if (!new_inode) {
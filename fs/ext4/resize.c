@@ -818,6 +818,7 @@ int ext4_group_add(struct super_block *sb, struct ext4_new_group_data *input)
 		err = PTR_ERR(handle);
 		goto exit_put;
 	}
+	ext4_fc_mark_fs_ineligible(handle, sb);
 
 	if ((err = ext4_journal_get_write_access(handle, sbi->s_sbh)))
 		goto exit_journal;
@@ -1051,6 +1052,7 @@ int ext4_group_extend(struct super_block *sb, struct ext4_super_block *es,
 		ext4_warning(sb, "error %d on journal start", err);
 		goto exit_put;
 	}
+	ext4_fc_mark_fs_ineligible(handle, sb);
 
 	if ((err = ext4_journal_get_write_access(handle,
 						 EXT4_SB(sb)->s_sbh))) {
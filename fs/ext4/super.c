@@ -937,6 +937,8 @@ static struct inode *ext4_alloc_inode(struct super_block *sb)
 	ei->cur_aio_dio = NULL;
 	ei->i_sync_tid = 0;
 	ei->i_datasync_tid = 0;
+	ei->i_fc_ineligible_tid = 0;
+	ei->i_mb_stream_key = 0;
 	atomic_set(&ei->i_ioend_count, 0);
 	atomic_set(&ei->i_aiodio_unwritten, 0);
 
@@ -1138,6 +1140,8 @@ static int ext4_show_options(struct seq_file *seq, struct vfsmount *vfs)
 		seq_puts(seq, ",journal_checksum");
 	if (test_opt(sb, I_VERSION))
 		seq_puts(seq, ",i_version");
+	if (test_opt2(sb, FAST_COMMIT))
+		seq_puts(seq, ",fast_commit");
 	if (!test_opt(sb, DELALLOC) &&
 	    !(def_mount_opts & EXT4_DEFM_NODELALLOC))
 		seq_puts(seq, ",nodelalloc");
@@ -1360,6 +1364,7 @@ enum {
 	Opt_inode_readahead_blks, Opt_journal_ioprio,
 	Opt_dioread_nolock, Opt_dioread_lock,
 	Opt_discard, Opt_nodiscard, Opt_init_itable, Opt_noinit_itable,
+	Opt_fast_commit, Opt_nofast_commit,
 };
 
 static const match_table_t tokens = {
@@ -1435,6 +1440,8 @@ static const match_table_t tokens = {
 	{Opt_init_itable, "init_itable=%u"},
 	{Opt_init_itable, "init_itable"},
 	{Opt_noinit_itable, "noinit_itable"},
+	{Opt_fast_commit, "fast_commit"},
+	{Opt_nofast_commit, "nofast_commit"},
 	{Opt_err, NULL},
 };
 
@@ -1925,6 +1932,12 @@ set_qf_format:
 		case Opt_noinit_itable:
 			clear_opt(sb, INIT_INODE_TABLE);
 			break;
+		case Opt_fast_commit:
+			set_opt2(sb, FAST_COMMIT);
+			break;
+		case Opt_nofast_commit:
+			clear_opt2(sb, FAST_COMMIT);
+			break;
 		default:
 			ext4_msg(sb, KERN_ERR,
 			       "Unrecognized mount option \"%s\" "
@@ -2549,6 +2562,19 @@ static ssize_t inode_readahead_blks_store(struct ext4_attr *a,
 	return count;
 }
 
+static ssize_t mb_stream_mode_store(struct ext4_attr *a,
+				    struct ext4_sb_info *sbi,
+				    const char *buf, size_t count)
+{
+	unsigned long t;
+
+	if (parse_strtoul(buf, EXT4_MB_STREAM_CGROUP, &t))
+		return -EINVAL;
+
+	sbi->s_mb_stream_mode = t;
+	return count;
+}
+
 static ssize_t sbi_ui_show(struct ext4_attr *a,
 			   struct ext4_sb_info *sbi, char *buf)
 {
@@ -2600,6 +2626,8 @@ EXT4_RW_ATTR_SBI_UI(mb_max_to_scan, s_mb_max_to_scan);
 EXT4_RW_ATTR_SBI_UI(mb_min_to_scan, s_mb_min_to_scan);
 EXT4_RW_ATTR_SBI_UI(mb_order2_req, s_mb_order2_reqs);
 EXT4_RW_ATTR_SBI_UI(mb_stream_req, s_mb_stream_request);
+EXT4_ATTR_OFFSET(mb_stream_mode, 0644, sbi_ui_show,
+		 mb_stream_mode_store, s_mb_stream_mode);
 EXT4_RW_ATTR_SBI_UI(mb_group_prealloc, s_mb_group_prealloc);
 EXT4_RW_ATTR_SBI_UI(max_writeback_mb_bump, s_max_writeback_mb_bump);
 
@@ -2616,6 +2644,7 @@ static struct attribute *ext4_attrs[] = {
 	ATTR_LIST(mb_min_to_scan),
 	ATTR_LIST(mb_order2_req),
 	ATTR_LIST(mb_stream_req),
+	ATTR_LIST(mb_stream_mode),
 	ATTR_LIST(mb_group_prealloc),
 	ATTR_LIST(max_writeback_mb_bump),
 	NULL,
@@ -3561,6 +3590,7 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 
 	INIT_LIST_HEAD(&sbi->s_orphan); /* unlinked but open files */
 	mutex_init(&sbi->s_orphan_lock);
+	mutex_init(&sbi->s_fc_lock);
 	sbi->s_resize_flags = 0;
 
 	sb->s_root = NULL;
@@ -3589,6 +3619,7 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 		goto failed_mount_wq;
 	} else {
 		clear_opt(sb, DATA_FLAGS);
+		clear_opt2(sb, FAST_COMMIT);
 		sbi->s_journal = NULL;
 		needs_recovery = 0;
 		goto no_journal;
@@ -3644,6 +3675,13 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 	}
 	set_task_ioprio(sbi->s_journal->j_task, journal_ioprio);
 
+	if (!(sb->s_flags & MS_RDONLY)) {
+		if (test_opt2(sb, FAST_COMMIT))
+			ext4_fc_init(sb);
+		else
+			ext4_fc_release(sb);
+	}
+
 	/*
 	 * The journal may have updated the bg summary counts, so we
 	 * need to update the global counters.
@@ -4070,6 +4108,8 @@ static int ext4_load_journal(struct super_block *sb,
 		if (save)
 			memcpy(save, ((char *) es) +
 			       EXT4_S_ERR_START, EXT4_S_ERR_LEN);
+		/* fast commits from an earlier mount, whatever the options */
+		journal->j_fc_replay_callback = ext4_fc_replay;
 		err = jbd2_journal_load(journal);
 		if (save)
 			memcpy(((char *) es) + EXT4_S_ERR_START,
@@ -4390,6 +4430,18 @@ static int ext4_remount(struct super_block *sb, int *flags, char *data)
 	if (sbi->s_mount_flags & EXT4_MF_FS_ABORTED)
 		ext4_abort(sb, "Abort forced by user");
 
+	/*
+	 * The fast commit area can only be set up or dropped while the
+	 * journal is empty, on the way to read-write.
+	 */
+	if ((sbi->s_mount_opt2 ^ old_opts.s_mount_opt2) &
+	    EXT4_MOUNT2_FAST_COMMIT && !(sb->s_flags & MS_RDONLY)) {
+		ext4_msg(sb, KERN_ERR, "Cannot change fast_commit on a "
+			 "read-write remount");
+		err = -EINVAL;
+		goto restore_opts;
+	}
+
 	sb->s_flags = (sb->s_flags & ~MS_POSIXACL) |
 		(test_opt(sb, POSIX_ACL) ? MS_POSIXACL : 0);
 
@@ -4473,8 +4525,13 @@ static int ext4_remount(struct super_block *sb, int *flags, char *data)
 			 * been changed by e2fsck since we originally mounted
 			 * the partition.)
 			 */
-			if (sbi->s_journal)
+			if (sbi->s_journal) {
 				ext4_clear_journal_err(sb, es);
+				if (test_opt2(sb, FAST_COMMIT))
+					ext4_fc_init(sb);
+				else
+					ext4_fc_release(sb);
+			}
 			sbi->s_mount_state = le16_to_cpu(es->s_state);
 			if ((err = ext4_group_extend(sb, es, n_blocks_count)))
 				goto restore_opts;
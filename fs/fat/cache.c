@@ -10,11 +10,26 @@
 
 #include <linux/fs.h>
 #include <linux/slab.h>
+#include <linux/sched.h>
 #include <linux/buffer_head.h>
 #include "fat.h"
 
 /* this must be > 0. */
 #define FAT_MAX_CACHE	8
+/* the cache grows by one entry per 2^FAT_CACHE_SCALE_SHIFT clusters */
+#define FAT_CACHE_SCALE_SHIFT	6
+#define FAT_MAX_CACHE_LARGE	64
+
+/*
+ * With the chain_map mount option, a regular file of at least
+ * FAT_CHAIN_MAP_MIN clusters gets its whole cluster chain mapped as
+ * extents the first time a lookup has to walk more than
+ * FAT_CHAIN_MAP_WALK clusters.  Files too fragmented to fit in
+ * FAT_CHAIN_MAP_MAX extents keep using the LRU cache only.
+ */
+#define FAT_CHAIN_MAP_MIN	1024
+#define FAT_CHAIN_MAP_WALK	64
+#define FAT_CHAIN_MAP_MAX	2048
 
 struct fat_cache {
 	struct list_head cache_list;
@@ -30,9 +45,24 @@ struct fat_cache_id {
 	int dcluster;
 };
 
+struct fat_chain_extent {
+	int fcluster;
+	int dcluster;
+	int nr_contig;
+};
+
+struct fat_chain_map {
+	int nr_extents;
+	struct fat_chain_extent ext[0];
+};
+
+/* larger files are seeked over more places, give them more entries */
 static inline int fat_max_cache(struct inode *inode)
 {
-	return FAT_MAX_CACHE;
+	loff_t nr = i_size_read(inode) >>
+		(MSDOS_SB(inode->i_sb)->cluster_bits + FAT_CACHE_SCALE_SHIFT);
+
+	return clamp_t(loff_t, nr, FAT_MAX_CACHE, FAT_MAX_CACHE_LARGE);
 }
 
 static struct kmem_cache *fat_cache_cachep;
@@ -78,31 +108,80 @@ static inline void fat_cache_update_lru(struct inode *inode,
 		list_move(&cache->cache_list, &MSDOS_I(inode)->cache_lru);
 }
 
+/*
+ * Binary search the extent of "fclus", or the last one before it if the
+ * chain has grown past the map.  Called with cache_lru_lock held.
+ */
+static int fat_chain_map_lookup(struct inode *inode, int fclus,
+				struct fat_cache_id *cid,
+				int *cached_fclus, int *cached_dclus)
+{
+	struct fat_chain_map *map = MSDOS_I(inode)->chain_map;
+	struct fat_chain_extent *ext;
+	int lo = 0, hi = map->nr_extents - 1, offset;
+
+	/* the first extent always starts at cluster 0 of the file */
+	while (lo < hi) {
+		int mid = (lo + hi + 1) / 2;
+
+		if (map->ext[mid].fcluster <= fclus)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	ext = &map->ext[lo];
+	offset = min(fclus - ext->fcluster, ext->nr_contig);
+
+	cid->id = MSDOS_I(inode)->cache_valid_id;
+	cid->nr_contig = ext->nr_contig;
+	cid->fcluster = ext->fcluster;
+	cid->dcluster = ext->dcluster;
+	*cached_fclus = cid->fcluster + offset;
+	*cached_dclus = cid->dcluster + offset;
+
+	return offset;
+}
+
 static int fat_cache_lookup(struct inode *inode, int fclus,
 			    struct fat_cache_id *cid,
 			    int *cached_fclus, int *cached_dclus)
 {
 	static struct fat_cache nohit = { .fcluster = 0, };
 
+	struct msdos_sb_info *sbi = MSDOS_SB(inode->i_sb);
 	struct fat_cache *hit = &nohit, *p;
-	int offset = -1;
+	int offset = -1, hit_offset = -1;
 
 	spin_lock(&MSDOS_I(inode)->cache_lru_lock);
+	if (MSDOS_I(inode)->chain_map) {
+		offset = fat_chain_map_lookup(inode, fclus, cid,
+					      cached_fclus, cached_dclus);
+		if (*cached_fclus == fclus) {
+			atomic_long_inc(&sbi->chain_map_hits);
+			/* nothing new to add to the LRU */
+			cid->fcluster = -1;
+			goto out;
+		}
+	}
+
 	list_for_each_entry(p, &MSDOS_I(inode)->cache_lru, cache_list) {
 		/* Find the cache of "fclus" or nearest cache. */
 		if (p->fcluster <= fclus && hit->fcluster < p->fcluster) {
 			hit = p;
 			if ((hit->fcluster + hit->nr_contig) < fclus) {
-				offset = hit->nr_contig;
+				hit_offset = hit->nr_contig;
 			} else {
-				offset = fclus - hit->fcluster;
+				hit_offset = fclus - hit->fcluster;
 				break;
 			}
 		}
 	}
-	if (hit != &nohit) {
+	/* the map only falls short of the LRU past its end */
+	if (hit != &nohit &&
+	    (offset < 0 || hit->fcluster + hit_offset > *cached_fclus)) {
 		fat_cache_update_lru(inode, hit);
 
+		offset = hit_offset;
 		cid->id = MSDOS_I(inode)->cache_valid_id;
 		cid->nr_contig = hit->nr_contig;
 		cid->fcluster = hit->fcluster;
@@ -110,6 +189,7 @@ static int fat_cache_lookup(struct inode *inode, int fclus,
 		*cached_fclus = cid->fcluster + offset;
 		*cached_dclus = cid->dcluster + offset;
 	}
+out:
 	spin_unlock(&MSDOS_I(inode)->cache_lru_lock);
 
 	return offset;
@@ -184,11 +264,13 @@ out:
  * Cache invalidation occurs rarely, thus the LRU chain is not updated. It
  * fixes itself after a while.
  */
-static void __fat_cache_inval_inode(struct inode *inode)
+static struct fat_chain_map *__fat_cache_inval_inode(struct inode *inode)
 {
 	struct msdos_inode_info *i = MSDOS_I(inode);
+	struct fat_chain_map *map = i->chain_map;
 	struct fat_cache *cache;
 
+	i->chain_map = NULL;
 	while (!list_empty(&i->cache_lru)) {
 		cache = list_entry(i->cache_lru.next, struct fat_cache, cache_list);
 		list_del_init(&cache->cache_list);
@@ -199,13 +281,19 @@ static void __fat_cache_inval_inode(struct inode *inode)
 	i->cache_valid_id++;
 	if (i->cache_valid_id == FAT_CACHE_VALID)
 		i->cache_valid_id++;
+
+	/* the caller frees it, outside of the lock */
+	return map;
 }
 
 void fat_cache_inval_inode(struct inode *inode)
 {
+	struct fat_chain_map *map;
+
 	spin_lock(&MSDOS_I(inode)->cache_lru_lock);
-	__fat_cache_inval_inode(inode);
+	map = __fat_cache_inval_inode(inode);
 	spin_unlock(&MSDOS_I(inode)->cache_lru_lock);
+	kfree(map);
 }
 
 static inline int cache_contiguous(struct fat_cache_id *cid, int dclus)
@@ -222,10 +310,115 @@ static inline void cache_init(struct fat_cache_id *cid, int fclus, int dclus)
 	cid->nr_contig = 0;
 }
 
+static int fat_chain_map_wanted(struct inode *inode)
+{
+	struct msdos_inode_info *i = MSDOS_I(inode);
+
+	return MSDOS_SB(inode->i_sb)->options.chain_map &&
+		S_ISREG(inode->i_mode) && !i->chain_map &&
+		i->chain_map_fail_id != i->cache_valid_id &&
+		(i_size_read(inode) >> MSDOS_SB(inode->i_sb)->cluster_bits) >=
+		FAT_CHAIN_MAP_MIN;
+}
+
+/*
+ * Walk the cluster chain once, up to the last cluster i_size covers, and
+ * record it as extents.  Clusters past i_size, which a write may still be
+ * adding or a truncate be freeing, are left to fat_get_cluster() to walk.
+ * Errors in the chain are left for it to report too.  Returns 0 if the
+ * inode has a chain map afterwards.
+ */
+static int fat_chain_map_build(struct inode *inode)
+{
+	struct super_block *sb = inode->i_sb;
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+	struct msdos_inode_info *i = MSDOS_I(inode);
+	const int limit = sb->s_maxbytes >> sbi->cluster_bits;
+	struct fat_chain_map *map, *new;
+	struct fat_chain_extent *ext;
+	struct fat_entry fatent;
+	unsigned int id;
+	int size = 16, fclus = 0, dclus, nr, last;
+
+	spin_lock(&i->cache_lru_lock);
+	id = i->cache_valid_id;
+	dclus = i->i_start;
+	spin_unlock(&i->cache_lru_lock);
+	last = ((i_size_read(inode) + sbi->cluster_size - 1) >>
+		sbi->cluster_bits) - 1;
+
+	map = kmalloc(sizeof(*map) + size * sizeof(*ext), GFP_NOFS);
+	if (!map)
+		goto failed;
+	ext = map->ext;
+	ext->fcluster = 0;
+	ext->dcluster = dclus;
+	ext->nr_contig = 0;
+	map->nr_extents = 1;
+
+	fatent_init(&fatent);
+	while (fclus < last) {
+		nr = fat_ent_read(inode, &fatent, dclus);
+		atomic_long_inc(&sbi->chain_reads);
+		if (nr == FAT_ENT_EOF)
+			break;
+		if (nr < FAT_START_ENT || ++fclus > limit)
+			goto failed_brelse;
+
+		if (nr == dclus + 1) {
+			ext->nr_contig++;
+		} else {
+			if (map->nr_extents == size) {
+				if (size == FAT_CHAIN_MAP_MAX)
+					goto failed_brelse;
+				size = min(size * 2, FAT_CHAIN_MAP_MAX);
+				new = krealloc(map, sizeof(*map) +
+					       size * sizeof(*ext), GFP_NOFS);
+				if (!new)
+					goto failed_brelse;
+				map = new;
+			}
+			ext = &map->ext[map->nr_extents++];
+			ext->fcluster = fclus;
+			ext->dcluster = nr;
+			ext->nr_contig = 0;
+		}
+		dclus = nr;
+		cond_resched();
+	}
+	fatent_brelse(&fatent);
+
+	spin_lock(&i->cache_lru_lock);
+	if (id != i->cache_valid_id) {
+		/* truncated meanwhile */
+		spin_unlock(&i->cache_lru_lock);
+		kfree(map);
+		return -EAGAIN;
+	}
+	if (!i->chain_map) {
+		i->chain_map = map;
+		map = NULL;
+		atomic_long_inc(&sbi->chain_map_builds);
+	}
+	spin_unlock(&i->cache_lru_lock);
+	kfree(map);
+	return 0;
+
+failed_brelse:
+	fatent_brelse(&fatent);
+failed:
+	kfree(map);
+	spin_lock(&i->cache_lru_lock);
+	i->chain_map_fail_id = id;
+	spin_unlock(&i->cache_lru_lock);
+	return -ENOMEM;
+}
+
 int fat_get_cluster(struct inode *inode, int cluster, int *fclus, int *dclus)
 {
 	struct super_block *sb = inode->i_sb;
-	const int limit = sb->s_maxbytes >> MSDOS_SB(sb)->cluster_bits;
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+	const int limit = sb->s_maxbytes >> sbi->cluster_bits;
 	struct fat_entry fatent;
 	struct fat_cache_id cid;
 	int nr;
@@ -245,6 +438,19 @@ int fat_get_cluster(struct inode *inode, int cluster, int *fclus, int *dclus)
 		cache_init(&cid, -1, -1);
 	}
 
+	if (cluster - *fclus > FAT_CHAIN_MAP_WALK &&
+	    fat_chain_map_wanted(inode) && !fat_chain_map_build(inode)) {
+		*fclus = 0;
+		*dclus = MSDOS_I(inode)->i_start;
+		if (fat_cache_lookup(inode, cluster, &cid, fclus, dclus) < 0)
+			cache_init(&cid, -1, -1);
+	}
+
+	if (*fclus == cluster)
+		atomic_long_inc(&sbi->cache_hits);
+	else
+		atomic_long_inc(&sbi->cache_misses);
+
 	fatent_init(&fatent);
 	while (*fclus < cluster) {
 		/* prevent the infinite loop of cluster chain */
@@ -258,6 +464,7 @@ int fat_get_cluster(struct inode *inode, int cluster, int *fclus, int *dclus)
 		}
 
 		nr = fat_ent_read(inode, &fatent, *dclus);
+		atomic_long_inc(&sbi->chain_reads);
 		if (nr < 0)
 			goto out;
 		else if (nr == FAT_ENT_FREE) {
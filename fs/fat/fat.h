@@ -7,6 +7,7 @@
 #include <linux/fs.h>
 #include <linux/mutex.h>
 #include <linux/ratelimit.h>
+#include <linux/workqueue.h>
 #include <linux/msdos_fs.h>
 
 /*
@@ -46,7 +47,8 @@ struct fat_mount_options {
 		 usefree:1,	  /* Use free_clusters for FAT32 */
 		 tz_utc:1,	  /* Filesystem timestamps are in UTC */
 		 rodir:1,	  /* allow ATTR_RO for directory */
-		 discard:1;	  /* Issue discard requests on deletions */
+		 discard:1,	  /* Issue discard requests on deletions */
+		 chain_map:1;	  /* Map the cluster chain of large files */
 };
 
 #define FAT_HASH_BITS	8
@@ -72,6 +74,11 @@ struct msdos_sb_info {
 	unsigned int prev_free;      /* previously allocated cluster number */
 	unsigned int free_clusters;  /* -1 if undefined */
 	unsigned int free_clus_valid; /* is free_clusters valid? */
+	unsigned long *free_bitmap;  /* set bits: free clusters */
+	unsigned int free_bitmap_end; /* bitmap is filled in up to here */
+	unsigned int free_bitmap_msecs; /* time the scan took */
+	int free_bitmap_queued, free_bitmap_stop;
+	struct work_struct free_bitmap_work;
 	struct fat_mount_options options;
 	struct nls_table *nls_disk;  /* Codepage used on disk */
 	struct nls_table *nls_io;    /* Charset used for input and display */
@@ -88,6 +95,14 @@ struct msdos_sb_info {
 
 	spinlock_t inode_hash_lock;
 	struct hlist_head inode_hashtable[FAT_HASH_SIZE];
+
+	/* fat_get_cluster() statistics, in /proc/fs/fat/<dev>/stats */
+	atomic_long_t cache_hits;	/* answered without reading the FAT */
+	atomic_long_t cache_misses;
+	atomic_long_t chain_reads;	/* FAT entries read following chains */
+	atomic_long_t chain_map_hits;
+	atomic_long_t chain_map_builds;
+	struct proc_dir_entry *proc_dir;
 };
 
 #define FAT_CACHE_VALID	0	/* special case for valid cache */
@@ -101,6 +116,8 @@ struct msdos_inode_info {
 	int nr_caches;
 	/* for avoiding the race between fat_free() and fat_get_cluster() */
 	unsigned int cache_valid_id;
+	struct fat_chain_map *chain_map;	/* extents of the whole chain */
+	unsigned int chain_map_fail_id;	/* cache_valid_id it didn't fit in */
 
 	/* NOTE: mmu_private is 64bits, so must hold ->i_mutex to access */
 	loff_t mmu_private;	/* physically allocated size */
@@ -301,6 +318,8 @@ extern int fat_alloc_clusters(struct inode *inode, int *cluster,
 			      int nr_cluster);
 extern int fat_free_clusters(struct inode *inode, int cluster);
 extern int fat_count_free_clusters(struct super_block *sb);
+extern void fat_free_bitmap_start(struct super_block *sb);
+extern void fat_free_bitmap_release(struct super_block *sb);
 
 /* fat/file.c */
 extern long fat_generic_ioctl(struct file *filp, unsigned int cmd,
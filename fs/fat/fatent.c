@@ -7,6 +7,8 @@
 #include <linux/fs.h>
 #include <linux/msdos_fs.h>
 #include <linux/blkdev.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 #include "fat.h"
 
 struct fatent_operations {
@@ -286,11 +288,14 @@ static inline void unlock_fat(struct msdos_sb_info *sbi)
 	mutex_unlock(&sbi->fat_lock);
 }
 
+static void fat_free_bitmap_work(struct work_struct *work);
+
 void fat_ent_access_init(struct super_block *sb)
 {
 	struct msdos_sb_info *sbi = MSDOS_SB(sb);
 
 	mutex_init(&sbi->fat_lock);
+	INIT_WORK(&sbi->free_bitmap_work, fat_free_bitmap_work);
 
 	switch (sbi->fat_bits) {
 	case 32:
@@ -434,6 +439,52 @@ static inline int fat_ent_read_block(struct super_block *sb,
 	return ops->ent_bread(sb, fatent, offset, blocknr);
 }
 
+/*
+ * The free cluster bitmap is filled in by fat_free_bitmap_work() from
+ * FAT_START_ENT up to free_bitmap_end.  Entries below free_bitmap_end
+ * are kept up to date by the allocator, the others are read by the
+ * scan when it gets there.  All of it is under fat_lock.
+ */
+static inline void fat_free_bitmap_update(struct msdos_sb_info *sbi,
+					  int entry, int free)
+{
+	if (!sbi->free_bitmap || entry >= sbi->free_bitmap_end)
+		return;
+	if (free)
+		__set_bit(entry, sbi->free_bitmap);
+	else
+		__clear_bit(entry, sbi->free_bitmap);
+}
+
+static inline int fat_free_bitmap_ready(struct msdos_sb_info *sbi)
+{
+	return sbi->free_bitmap && sbi->free_bitmap_end == sbi->max_cluster;
+}
+
+/* drop a bitmap that turned out to be wrong, the scan is over */
+static void fat_free_bitmap_put(struct msdos_sb_info *sbi)
+{
+	vfree(sbi->free_bitmap);
+	sbi->free_bitmap = NULL;
+	sbi->free_bitmap_end = 0;
+}
+
+/* the first free entry from @entry on, wrapping around, or -1 */
+static int fat_free_bitmap_next(struct msdos_sb_info *sbi, int entry)
+{
+	unsigned long next;
+
+	if (entry < FAT_START_ENT || entry >= sbi->max_cluster)
+		entry = FAT_START_ENT;
+	next = find_next_bit(sbi->free_bitmap, sbi->max_cluster, entry);
+	if (next >= sbi->max_cluster)
+		next = find_next_bit(sbi->free_bitmap, sbi->max_cluster,
+				     FAT_START_ENT);
+	if (next >= sbi->max_cluster)
+		return -1;
+	return next;
+}
+
 static void fat_collect_bhs(struct buffer_head **bhs, int *nr_bhs,
 			    struct fat_entry *fatent)
 {
@@ -474,6 +525,50 @@ int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 	count = FAT_START_ENT;
 	fatent_init(&prev_ent);
 	fatent_init(&fatent);
+
+	if (fat_free_bitmap_ready(sbi)) {
+		int entry = sbi->prev_free + 1;
+
+		while ((entry = fat_free_bitmap_next(sbi, entry)) >= 0) {
+			err = fat_ent_read(inode, &fatent, entry);
+			if (err < 0)
+				goto out;
+			if (err != FAT_ENT_FREE) {
+				/* should not happen, don't trust the bitmap */
+				fat_fs_error(sb, "%s: free cluster bitmap is "
+					     "stale (entry 0x%08x)", __func__,
+					     entry);
+				fat_free_bitmap_put(sbi);
+				break;
+			}
+			err = 0;
+
+			/* make the cluster chain */
+			ops->ent_put(&fatent, FAT_ENT_EOF);
+			if (prev_ent.nr_bhs)
+				ops->ent_put(&prev_ent, entry);
+
+			fat_collect_bhs(bhs, &nr_bhs, &fatent);
+
+			sbi->prev_free = entry;
+			if (sbi->free_clusters != -1)
+				sbi->free_clusters--;
+			fat_free_bitmap_update(sbi, entry, 0);
+			sb->s_dirt = 1;
+
+			cluster[idx_clus] = entry;
+			idx_clus++;
+			if (idx_clus == nr_cluster)
+				goto out;
+
+			prev_ent = fatent;
+			entry++;
+		}
+		if (fat_free_bitmap_ready(sbi))
+			goto no_space;
+		/* the bitmap was dropped, go on with the FAT */
+	}
+
 	fatent_set_entry(&fatent, sbi->prev_free + 1);
 	while (count < sbi->max_cluster) {
 		if (fatent.entry >= sbi->max_cluster)
@@ -498,6 +593,7 @@ int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 				sbi->prev_free = entry;
 				if (sbi->free_clusters != -1)
 					sbi->free_clusters--;
+				fat_free_bitmap_update(sbi, entry, 0);
 				sb->s_dirt = 1;
 
 				cluster[idx_clus] = entry;
@@ -517,6 +613,7 @@ int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 		} while (fat_ent_next(sbi, &fatent));
 	}
 
+no_space:
 	/* Couldn't allocate the free entries */
 	sbi->free_clusters = 0;
 	sbi->free_clus_valid = 1;
@@ -585,6 +682,7 @@ int fat_free_clusters(struct inode *inode, int cluster)
 		}
 
 		ops->ent_put(&fatent, FAT_ENT_FREE);
+		fat_free_bitmap_update(sbi, fatent.entry, 1);
 		if (sbi->free_clusters != -1) {
 			sbi->free_clusters++;
 			sb->s_dirt = 1;
@@ -639,6 +737,125 @@ static void fat_ent_reada(struct super_block *sb, struct fat_entry *fatent,
 		sb_breadahead(sb, blocknr + i);
 }
 
+/* read ahead @nr blocks of the first FAT, from its block @start on */
+static void fat_reada_blocks(struct super_block *sb, unsigned long start,
+			     unsigned long nr)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+	struct blk_plug plug;
+	unsigned long i;
+
+	if (start >= sbi->fat_length)
+		return;
+	nr = min(nr, sbi->fat_length - start);
+
+	blk_start_plug(&plug);
+	for (i = 0; i < nr; i++)
+		sb_breadahead(sb, sbi->fat_start + start + i);
+	blk_finish_plug(&plug);
+}
+
+/*
+ * Build the free cluster bitmap in the background.  The FAT is read one
+ * readahead window ahead of the block being looked at, so the device
+ * always has the next window to work on, and fat_lock is only taken for
+ * one block at a time: allocations go on meanwhile, from the FAT.
+ */
+static void fat_free_bitmap_work(struct work_struct *work)
+{
+	struct msdos_sb_info *sbi = container_of(work, struct msdos_sb_info,
+						 free_bitmap_work);
+	struct super_block *sb = sbi->fat_inode->i_sb;
+	struct fatent_operations *ops = sbi->fatent_ops;
+	unsigned long reada_blocks, reada_mask, cur_block;
+	unsigned long *bitmap;
+	struct fat_entry fatent;
+	unsigned long start = jiffies;
+	int err = 0;
+
+	bitmap = vzalloc(BITS_TO_LONGS(sbi->max_cluster) * sizeof(long));
+	if (!bitmap)
+		return;
+
+	lock_fat(sbi);
+	sbi->free_bitmap = bitmap;
+	sbi->free_bitmap_end = FAT_START_ENT;
+	unlock_fat(sbi);
+
+	reada_blocks = FAT_READA_SIZE >> sb->s_blocksize_bits;
+	reada_mask = reada_blocks - 1;
+	cur_block = 0;
+
+	fatent_init(&fatent);
+	fatent_set_entry(&fatent, FAT_START_ENT);
+	fat_reada_blocks(sb, 0, reada_blocks);
+	while (fatent.entry < sbi->max_cluster) {
+		if (sbi->free_bitmap_stop) {
+			err = -EINTR;
+			break;
+		}
+		if ((cur_block & reada_mask) == 0)
+			fat_reada_blocks(sb, cur_block + reada_blocks,
+					 reada_blocks);
+		cur_block++;
+
+		lock_fat(sbi);
+		err = fat_ent_read_block(sb, &fatent);
+		if (err) {
+			unlock_fat(sbi);
+			break;
+		}
+		do {
+			if (ops->ent_get(&fatent) == FAT_ENT_FREE)
+				__set_bit(fatent.entry, bitmap);
+		} while (fat_ent_next(sbi, &fatent));
+		sbi->free_bitmap_end = min_t(unsigned long, fatent.entry,
+					     sbi->max_cluster);
+		unlock_fat(sbi);
+		cond_resched();
+	}
+	fatent_brelse(&fatent);
+
+	lock_fat(sbi);
+	if (err) {
+		sbi->free_bitmap = NULL;
+		sbi->free_bitmap_end = 0;
+		unlock_fat(sbi);
+		vfree(bitmap);
+		return;
+	}
+	sbi->free_clusters = bitmap_weight(bitmap, sbi->max_cluster);
+	sbi->free_clus_valid = 1;
+	sbi->free_bitmap_msecs = jiffies_to_msecs(jiffies - start);
+	sb->s_dirt = 1;
+	unlock_fat(sbi);
+}
+
+/* Start building the free cluster bitmap, if not done yet. */
+void fat_free_bitmap_start(struct super_block *sb)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+
+	lock_fat(sbi);
+	if (!sbi->free_bitmap_queued) {
+		sbi->free_bitmap_queued = 1;
+		sbi->free_bitmap_stop = 0;
+		queue_work(system_long_wq, &sbi->free_bitmap_work);
+	}
+	unlock_fat(sbi);
+}
+
+/* Stop the scan and free the bitmap, at unmount. */
+void fat_free_bitmap_release(struct super_block *sb)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+
+	sbi->free_bitmap_stop = 1;
+	cancel_work_sync(&sbi->free_bitmap_work);
+	vfree(sbi->free_bitmap);
+	sbi->free_bitmap = NULL;
+}
+
 int fat_count_free_clusters(struct super_block *sb)
 {
 	struct msdos_sb_info *sbi = MSDOS_SB(sb);
@@ -651,6 +868,15 @@ int fat_count_free_clusters(struct super_block *sb)
 	if (sbi->free_clusters != -1 && sbi->free_clus_valid)
 		goto out;
 
+	/* the bitmap scan counts them too, wait for it */
+	if (sbi->free_bitmap_queued) {
+		unlock_fat(sbi);
+		flush_work(&sbi->free_bitmap_work);
+		lock_fat(sbi);
+		if (sbi->free_clusters != -1 && sbi->free_clus_valid)
+			goto out;
+	}
+
 	reada_blocks = FAT_READA_SIZE >> sb->s_blocksize_bits;
 	reada_mask = reada_blocks - 1;
 	cur_block = 0;
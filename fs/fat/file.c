@@ -280,7 +280,14 @@ static int fat_free(struct inode *inode, int skip)
 	inode->i_blocks = skip << (MSDOS_SB(sb)->cluster_bits - 9);
 
 	/* Freeing the remained cluster chain */
-	return fat_free_clusters(inode, free_start);
+	err = fat_free_clusters(inode, free_start);
+
+	/*
+	 * fat_get_cluster() above may have cached or mapped the old chain
+	 * again, freed clusters included: drop it now that it has changed.
+	 */
+	fat_cache_inval_inode(inode);
+	return err;
 }
 
 void fat_truncate_blocks(struct inode *inode, loff_t offset)
@@ -15,6 +15,7 @@
 #include <linux/time.h>
 #include <linux/slab.h>
 #include <linux/seq_file.h>
+#include <linux/proc_fs.h>
 #include <linux/pagemap.h>
 #include <linux/mpage.h>
 #include <linux/buffer_head.h>
@@ -487,13 +488,64 @@ static int fat_sync_fs(struct super_block *sb, int wait)
 	return err;
 }
 
+static struct proc_dir_entry *fat_proc_root;
+
+/*
+ * /proc/fs/fat/<dev>/stats: how often fat_get_cluster() found the
+ * cluster in the per inode caches, and how many FAT entries it read
+ * when it did not.
+ */
+static int fat_stats_show(struct seq_file *m, void *v)
+{
+	struct msdos_sb_info *sbi = m->private;
+	unsigned long hits = atomic_long_read(&sbi->cache_hits);
+	unsigned long misses = atomic_long_read(&sbi->cache_misses);
+
+	seq_printf(m, "cache_hits: %lu\n", hits);
+	seq_printf(m, "cache_misses: %lu\n", misses);
+	seq_printf(m, "cache_hit_percent: %lu\n", hits + misses ?
+		   hits * 100 / (hits + misses) : 0);
+	seq_printf(m, "chain_reads: %lu\n",
+		   atomic_long_read(&sbi->chain_reads));
+	seq_printf(m, "chain_map_hits: %lu\n",
+		   atomic_long_read(&sbi->chain_map_hits));
+	seq_printf(m, "chain_map_builds: %lu\n",
+		   atomic_long_read(&sbi->chain_map_builds));
+	seq_printf(m, "free_bitmap: %s\n", !sbi->free_bitmap ? "none" :
+		   sbi->free_bitmap_end < sbi->max_cluster ? "scanning" :
+		   "ready");
+	seq_printf(m, "free_bitmap_scan_ms: %u\n", sbi->free_bitmap_msecs);
+
+	return 0;
+}
+
+static int fat_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, fat_stats_show, PDE(inode)->data);
+}
+
+static const struct file_operations fat_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= fat_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static void fat_put_super(struct super_block *sb)
 {
 	struct msdos_sb_info *sbi = MSDOS_SB(sb);
 
+	fat_free_bitmap_release(sb);
+
 	if (sb->s_dirt)
 		fat_write_super(sb);
 
+	if (sbi->proc_dir) {
+		remove_proc_entry("stats", sbi->proc_dir);
+		remove_proc_entry(sb->s_id, fat_proc_root);
+	}
+
 	iput(sbi->fat_inode);
 
 	unload_nls(sbi->nls_disk);
@@ -538,6 +590,8 @@ static void init_once(void *foo)
 	spin_lock_init(&ei->cache_lru_lock);
 	ei->nr_caches = 0;
 	ei->cache_valid_id = FAT_CACHE_VALID + 1;
+	ei->chain_map = NULL;
+	ei->chain_map_fail_id = FAT_CACHE_VALID;
 	INIT_LIST_HEAD(&ei->cache_lru);
 	INIT_HLIST_NODE(&ei->i_fat_hash);
 	inode_init_once(&ei->vfs_inode);
@@ -564,6 +618,8 @@ static int fat_remount(struct super_block *sb, int *flags, char *data)
 {
 	struct msdos_sb_info *sbi = MSDOS_SB(sb);
 	*flags |= MS_NODIRATIME | (sbi->options.isvfat ? 0 : MS_NOATIME);
+	if (!(*flags & MS_RDONLY))
+		fat_free_bitmap_start(sb);
 	return 0;
 }
 
@@ -890,6 +946,8 @@ static int fat_show_options(struct seq_file *m, struct vfsmount *mnt)
 		seq_puts(m, ",errors=remount-ro");
 	if (opts->discard)
 		seq_puts(m, ",discard");
+	if (opts->chain_map)
+		seq_puts(m, ",chain_map");
 
 	return 0;
 }
@@ -903,7 +961,7 @@ enum {
 	Opt_shortname_winnt, Opt_shortname_mixed, Opt_utf8_no, Opt_utf8_yes,
 	Opt_uni_xl_no, Opt_uni_xl_yes, Opt_nonumtail_no, Opt_nonumtail_yes,
 	Opt_obsolate, Opt_flush, Opt_tz_utc, Opt_rodir, Opt_err_cont,
-	Opt_err_panic, Opt_err_ro, Opt_discard, Opt_err,
+	Opt_err_panic, Opt_err_ro, Opt_discard, Opt_chain_map, Opt_err,
 };
 
 static const match_table_t fat_tokens = {
@@ -932,6 +990,7 @@ static const match_table_t fat_tokens = {
 	{Opt_err_panic, "errors=panic"},
 	{Opt_err_ro, "errors=remount-ro"},
 	{Opt_discard, "discard"},
+	{Opt_chain_map, "chain_map"},
 	{Opt_obsolate, "conv=binary"},
 	{Opt_obsolate, "conv=text"},
 	{Opt_obsolate, "conv=auto"},
@@ -1172,6 +1231,9 @@ static int parse_options(struct super_block *sb, char *options, int is_vfat,
 		case Opt_discard:
 			opts->discard = 1;
 			break;
+		case Opt_chain_map:
+			opts->chain_map = 1;
+			break;
 
 		/* obsolete mount options */
 		case Opt_obsolate:
@@ -1520,6 +1582,16 @@ int fat_fill_super(struct super_block *sb, void *data, int silent, int isvfat,
 		goto out_fail;
 	}
 
+	if (fat_proc_root)
+		sbi->proc_dir = proc_mkdir(sb->s_id, fat_proc_root);
+	if (sbi->proc_dir)
+		proc_create_data("stats", S_IRUGO, sbi->proc_dir,
+				 &fat_stats_fops, sbi);
+
+	/* allocations will use it once it is complete */
+	if (!(sb->s_flags & MS_RDONLY))
+		fat_free_bitmap_start(sb);
+
 	return 0;
 
 out_invalid:
@@ -1605,6 +1677,9 @@ static int __init init_fat_fs(void)
 	if (err)
 		goto failed;
 
+	/* the statistics are optional */
+	fat_proc_root = proc_mkdir("fs/fat", NULL);
+
 	return 0;
 
 failed:
@@ -1614,6 +1689,8 @@ failed:
 
 static void __exit exit_fat_fs(void)
 {
+	if (fat_proc_root)
+		remove_proc_entry("fs/fat", NULL);
 	fat_cache_destroy();
 	fat_destroy_inodecache();
 }
@@ -410,7 +410,7 @@ static int cuse_send_init(struct cuse_conn *cc)
 
 	BUILD_BUG_ON(CUSE_INIT_INFO_MAX > PAGE_SIZE);
 
-	req = fuse_get_req(fc);
+	req = fuse_get_req(fc, 1);
 	if (IS_ERR(req)) {
 		rc = PTR_ERR(req);
 		goto err;
@@ -478,6 +478,7 @@ static void cuse_fc_release(struct fuse_conn *fc)
 static int cuse_channel_open(struct inode *inode, struct file *file)
 {
 	struct cuse_conn *cc;
+	struct fuse_chan *chan;
 	int rc;
 
 	/* set up cuse_conn */
@@ -490,14 +491,21 @@ static int cuse_channel_open(struct inode *inode, struct file *file)
 	INIT_LIST_HEAD(&cc->list);
 	cc->fc.release = cuse_fc_release;
 
+	chan = fuse_chan_alloc(&cc->fc);
+	if (!chan) {
+		fuse_conn_put(&cc->fc);
+		return -ENOMEM;
+	}
+	fuse_chan_install(chan);	/* channel owns base reference to cc */
+	file->private_data = chan;
+
 	cc->fc.connected = 1;
 	cc->fc.blocked = 0;
 	rc = cuse_send_init(cc);
 	if (rc) {
-		fuse_conn_put(&cc->fc);
+		fuse_dev_release(inode, file);
 		return rc;
 	}
-	file->private_data = &cc->fc;	/* channel owns base reference to cc */
 
 	return 0;
 }
@@ -515,7 +523,8 @@ static int cuse_channel_open(struct inode *inode, struct file *file)
  */
 static int cuse_channel_release(struct inode *inode, struct file *file)
 {
-	struct cuse_conn *cc = fc_to_cc(file->private_data);
+	struct fuse_chan *chan = file->private_data;
+	struct cuse_conn *cc = fc_to_cc(chan->fc);
 	int rc;
 
 	/* remove from the conntbl, no more access from this point on */
@@ -26,43 +26,71 @@ MODULE_ALIAS("devname:fuse");
 
 static struct kmem_cache *fuse_req_cachep;
 
-static struct fuse_conn *fuse_get_conn(struct file *file)
+static struct fuse_chan *fuse_get_chan(struct file *file)
 {
 	/*
 	 * Lockless access is OK, because file->private data is set
-	 * once during mount and is valid until the file is released.
+	 * once during mount (or clone) and is valid until the file is
+	 * released.
 	 */
 	return file->private_data;
 }
 
-static void fuse_request_init(struct fuse_req *req)
+static struct fuse_conn *fuse_get_conn(struct file *file)
+{
+	struct fuse_chan *chan = fuse_get_chan(file);
+
+	return chan ? chan->fc : NULL;
+}
+
+static void fuse_request_init(struct fuse_req *req, struct page **pages,
+			      unsigned npages)
 {
 	memset(req, 0, sizeof(*req));
 	INIT_LIST_HEAD(&req->list);
 	INIT_LIST_HEAD(&req->intr_entry);
 	init_waitqueue_head(&req->waitq);
 	atomic_set(&req->count, 1);
+	req->pages = pages;
+	req->max_pages = npages;
 }
 
-struct fuse_req *fuse_request_alloc(void)
+static struct fuse_req *__fuse_request_alloc(unsigned npages, gfp_t flags)
 {
-	struct fuse_req *req = kmem_cache_alloc(fuse_req_cachep, GFP_KERNEL);
-	if (req)
-		fuse_request_init(req);
+	struct fuse_req *req = kmem_cache_alloc(fuse_req_cachep, flags);
+	if (req) {
+		struct page **pages;
+
+		if (npages <= FUSE_REQ_INLINE_PAGES)
+			pages = req->inline_pages;
+		else
+			pages = kmalloc(sizeof(struct page *) * npages, flags);
+
+		if (!pages) {
+			kmem_cache_free(fuse_req_cachep, req);
+			return NULL;
+		}
+
+		fuse_request_init(req, pages, npages);
+	}
 	return req;
 }
+
+struct fuse_req *fuse_request_alloc(unsigned npages)
+{
+	return __fuse_request_alloc(npages, GFP_KERNEL);
+}
 EXPORT_SYMBOL_GPL(fuse_request_alloc);
 
-struct fuse_req *fuse_request_alloc_nofs(void)
+struct fuse_req *fuse_request_alloc_nofs(unsigned npages)
 {
-	struct fuse_req *req = kmem_cache_alloc(fuse_req_cachep, GFP_NOFS);
-	if (req)
-		fuse_request_init(req);
-	return req;
+	return __fuse_request_alloc(npages, GFP_NOFS);
 }
 
 void fuse_request_free(struct fuse_req *req)
 {
+	if (req->pages != req->inline_pages)
+		kfree(req->pages);
 	kmem_cache_free(fuse_req_cachep, req);
 }
 
@@ -98,7 +126,7 @@ static void fuse_req_init_context(struct fuse_req *req)
 	req->in.h.pid = current->pid;
 }
 
-struct fuse_req *fuse_get_req(struct fuse_conn *fc)
+struct fuse_req *fuse_get_req(struct fuse_conn *fc, unsigned npages)
 {
 	struct fuse_req *req;
 	sigset_t oldset;
@@ -117,7 +145,7 @@ struct fuse_req *fuse_get_req(struct fuse_conn *fc)
 	if (!fc->connected)
 		goto out;
 
-	req = fuse_request_alloc();
+	req = fuse_request_alloc(npages);
 	err = -ENOMEM;
 	if (!req)
 		goto out;
@@ -167,7 +195,7 @@ static void put_reserved_req(struct fuse_conn *fc, struct fuse_req *req)
 	struct fuse_file *ff = file->private_data;
 
 	spin_lock(&fc->lock);
-	fuse_request_init(req);
+	fuse_request_init(req, req->pages, req->max_pages);
 	BUG_ON(ff->reserved_req);
 	ff->reserved_req = req;
 	wake_up_all(&fc->reserved_req_waitq);
@@ -194,7 +222,7 @@ struct fuse_req *fuse_get_req_nofail(struct fuse_conn *fc, struct file *file)
 
 	atomic_inc(&fc->num_waiting);
 	wait_event(fc->blocked_waitq, !fc->blocked);
-	req = fuse_request_alloc();
+	req = fuse_request_alloc(0);
 	if (!req)
 		req = get_reserved_req(fc, file);
 
@@ -206,6 +234,10 @@ struct fuse_req *fuse_get_req_nofail(struct fuse_conn *fc, struct file *file)
 void fuse_put_request(struct fuse_conn *fc, struct fuse_req *req)
 {
 	if (atomic_dec_and_test(&req->count)) {
+		/* backing file not taken over by an open */
+		if (unlikely(req->passthrough))
+			fput(req->passthrough);
+
 		if (req->waiting)
 			atomic_dec(&fc->num_waiting);
 
@@ -238,18 +270,142 @@ static u64 fuse_get_unique(struct fuse_conn *fc)
 	return fc->reqctr;
 }
 
+struct fuse_chan *fuse_chan_alloc(struct fuse_conn *fc)
+{
+	struct fuse_chan *chan;
+
+	chan = kzalloc(sizeof(*chan), GFP_KERNEL);
+	if (!chan)
+		return NULL;
+
+	/*
+	 * The first channel is allocated before the connection is
+	 * visible to anyone else, so this can't race
+	 */
+	if (!fc->cpu_chan) {
+		fc->cpu_chan = kcalloc(nr_cpu_ids, sizeof(fc->cpu_chan[0]),
+				       GFP_KERNEL);
+		if (!fc->cpu_chan) {
+			kfree(chan);
+			return NULL;
+		}
+	}
+
+	chan->fc = fc;
+	init_waitqueue_head(&chan->waitq);
+	INIT_LIST_HEAD(&chan->pending);
+	INIT_LIST_HEAD(&chan->entry);
+	return chan;
+}
+EXPORT_SYMBOL_GPL(fuse_chan_alloc);
+
+/*
+ * Spread the CPUs over the channels round robin.
+ *
+ * Called with fc->lock held
+ */
+static void fuse_chan_remap(struct fuse_conn *fc)
+{
+	struct list_head *pos = &fc->chans;
+	unsigned cpu;
+
+	for (cpu = 0; cpu < nr_cpu_ids; cpu++) {
+		pos = pos->next;
+		if (pos == &fc->chans)
+			pos = pos->next;
+		if (pos == &fc->chans)
+			fc->cpu_chan[cpu] = NULL;
+		else
+			fc->cpu_chan[cpu] = list_entry(pos, struct fuse_chan,
+						       entry);
+	}
+}
+
+void fuse_chan_install(struct fuse_chan *chan)
+{
+	struct fuse_conn *fc = chan->fc;
+
+	spin_lock(&fc->lock);
+	list_add_tail(&chan->entry, &fc->chans);
+	fc->nr_chans++;
+	fuse_chan_remap(fc);
+	spin_unlock(&fc->lock);
+}
+EXPORT_SYMBOL_GPL(fuse_chan_install);
+
+/*
+ * Wake up a reader of @chan, or of any other channel if nobody is
+ * waiting on @chan, so that requests don't wait for a busy thread
+ * while another one is idle.
+ *
+ * Called with fc->lock held
+ */
+static void fuse_chan_wake(struct fuse_conn *fc, struct fuse_chan *chan)
+{
+	if (!waitqueue_active(&chan->waitq)) {
+		struct fuse_chan *other;
+
+		list_for_each_entry(other, &fc->chans, entry) {
+			if (waitqueue_active(&other->waitq)) {
+				chan = other;
+				break;
+			}
+		}
+	}
+	wake_up(&chan->waitq);
+	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+}
+
+/* Wake a reader for work not tied to a channel (interrupts, forgets) */
+static void fuse_wake_reader(struct fuse_conn *fc)
+{
+	struct fuse_chan *chan = fc->cpu_chan[smp_processor_id()];
+
+	if (chan)
+		fuse_chan_wake(fc, chan);
+}
+
+void fuse_wake_up_all(struct fuse_conn *fc)
+{
+	struct fuse_chan *chan;
+
+	list_for_each_entry(chan, &fc->chans, entry)
+		wake_up_all(&chan->waitq);
+}
+
+/*
+ * Detach a channel from the connection, handing its pending requests
+ * over to another channel.
+ *
+ * Called with fc->lock held
+ */
+static void fuse_chan_remove(struct fuse_conn *fc, struct fuse_chan *chan)
+{
+	list_del(&chan->entry);
+	fc->nr_chans--;
+	if (!list_empty(&fc->chans)) {
+		struct fuse_chan *other;
+
+		other = list_entry(fc->chans.next, struct fuse_chan, entry);
+		list_splice_tail_init(&chan->pending, &other->pending);
+		fuse_chan_wake(fc, other);
+	}
+	fuse_chan_remap(fc);
+}
+
 static void queue_request(struct fuse_conn *fc, struct fuse_req *req)
 {
+	struct fuse_chan *chan = fc->cpu_chan[smp_processor_id()];
+
 	req->in.h.len = sizeof(struct fuse_in_header) +
 		len_args(req->in.numargs, (struct fuse_arg *) req->in.args);
-	list_add_tail(&req->list, &fc->pending);
+	list_add_tail(&req->list, &chan->pending);
 	req->state = FUSE_REQ_PENDING;
 	if (!req->waiting) {
 		req->waiting = 1;
 		atomic_inc(&fc->num_waiting);
 	}
-	wake_up(&fc->waitq);
-	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	fuse_chan_wake(fc, chan);
 }
 
 void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
@@ -262,8 +418,7 @@ void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
 	if (fc->connected) {
 		fc->forget_list_tail->next = forget;
 		fc->forget_list_tail = forget;
-		wake_up(&fc->waitq);
-		kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+		fuse_wake_reader(fc);
 	} else {
 		kfree(forget);
 	}
@@ -339,8 +494,7 @@ __acquires(fc->lock)
 static void queue_interrupt(struct fuse_conn *fc, struct fuse_req *req)
 {
 	list_add_tail(&req->intr_entry, &fc->interrupts);
-	wake_up(&fc->waitq);
-	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	fuse_wake_reader(fc);
 }
 
 static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
@@ -915,21 +1069,43 @@ static int forget_pending(struct fuse_conn *fc)
 	return fc->forget_list_head.next != NULL;
 }
 
-static int request_pending(struct fuse_conn *fc)
+/*
+ * Return the first pending request of @chan, or failing that of any
+ * other channel of the connection
+ */
+static struct fuse_req *next_pending(struct fuse_chan *chan)
 {
-	return !list_empty(&fc->pending) || !list_empty(&fc->interrupts) ||
-		forget_pending(fc);
+	struct fuse_chan *other;
+
+	if (!list_empty(&chan->pending))
+		return list_entry(chan->pending.next, struct fuse_req, list);
+
+	list_for_each_entry(other, &chan->fc->chans, entry) {
+		if (!list_empty(&other->pending))
+			return list_entry(other->pending.next, struct fuse_req,
+					  list);
+	}
+	return NULL;
 }
 
-/* Wait until a request is available on the pending list */
-static void request_wait(struct fuse_conn *fc)
+static int request_pending(struct fuse_chan *chan)
+{
+	struct fuse_conn *fc = chan->fc;
+
+	return !list_empty(&fc->interrupts) || forget_pending(fc) ||
+		next_pending(chan) != NULL;
+}
+
+/* Wait until a request is available on the pending lists */
+static void request_wait(struct fuse_chan *chan)
 __releases(fc->lock)
 __acquires(fc->lock)
 {
+	struct fuse_conn *fc = chan->fc;
 	DECLARE_WAITQUEUE(wait, current);
 
-	add_wait_queue_exclusive(&fc->waitq, &wait);
-	while (fc->connected && !request_pending(fc)) {
+	add_wait_queue_exclusive(&chan->waitq, &wait);
+	while (fc->connected && !request_pending(chan)) {
 		set_current_state(TASK_INTERRUPTIBLE);
 		if (signal_pending(current))
 			break;
@@ -939,7 +1115,7 @@ __acquires(fc->lock)
 		spin_lock(&fc->lock);
 	}
 	set_current_state(TASK_RUNNING);
-	remove_wait_queue(&fc->waitq, &wait);
+	remove_wait_queue(&chan->waitq, &wait);
 }
 
 /*
@@ -1103,10 +1279,11 @@ __releases(fc->lock)
  * request_end().  Otherwise add it to the processing list, and set
  * the 'sent' flag.
  */
-static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
+static ssize_t fuse_dev_do_read(struct fuse_chan *chan, struct file *file,
 				struct fuse_copy_state *cs, size_t nbytes)
 {
 	int err;
+	struct fuse_conn *fc = chan->fc;
 	struct fuse_req *req;
 	struct fuse_in *in;
 	unsigned reqsize;
@@ -1115,15 +1292,15 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 	spin_lock(&fc->lock);
 	err = -EAGAIN;
 	if ((file->f_flags & O_NONBLOCK) && fc->connected &&
-	    !request_pending(fc))
+	    !request_pending(chan))
 		goto err_unlock;
 
-	request_wait(fc);
+	request_wait(chan);
 	err = -ENODEV;
 	if (!fc->connected)
 		goto err_unlock;
 	err = -ERESTARTSYS;
-	if (!request_pending(fc))
+	if (!request_pending(chan))
 		goto err_unlock;
 
 	if (!list_empty(&fc->interrupts)) {
@@ -1132,15 +1309,15 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 		return fuse_read_interrupt(fc, cs, nbytes, req);
 	}
 
+	req = next_pending(chan);
 	if (forget_pending(fc)) {
-		if (list_empty(&fc->pending) || fc->forget_batch-- > 0)
+		if (!req || fc->forget_batch-- > 0)
 			return fuse_read_forget(fc, cs, nbytes);
 
 		if (fc->forget_batch <= -8)
 			fc->forget_batch = 16;
 	}
 
-	req = list_entry(fc->pending.next, struct fuse_req, list);
 	req->state = FUSE_REQ_READING;
 	list_move(&req->list, &fc->io);
 
@@ -1194,13 +1371,13 @@ static ssize_t fuse_dev_read(struct kiocb *iocb, const struct iovec *iov,
 {
 	struct fuse_copy_state cs;
 	struct file *file = iocb->ki_filp;
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
+	struct fuse_chan *chan = fuse_get_chan(file);
+	if (!chan)
 		return -EPERM;
 
-	fuse_copy_init(&cs, fc, 1, iov, nr_segs);
+	fuse_copy_init(&cs, chan->fc, 1, iov, nr_segs);
 
-	return fuse_dev_do_read(fc, file, &cs, iov_length(iov, nr_segs));
+	return fuse_dev_do_read(chan, file, &cs, iov_length(iov, nr_segs));
 }
 
 static int fuse_dev_pipe_buf_steal(struct pipe_inode_info *pipe,
@@ -1228,18 +1405,18 @@ static ssize_t fuse_dev_splice_read(struct file *in, loff_t *ppos,
 	int do_wakeup = 0;
 	struct pipe_buffer *bufs;
 	struct fuse_copy_state cs;
-	struct fuse_conn *fc = fuse_get_conn(in);
-	if (!fc)
+	struct fuse_chan *chan = fuse_get_chan(in);
+	if (!chan)
 		return -EPERM;
 
 	bufs = kmalloc(pipe->buffers * sizeof(struct pipe_buffer), GFP_KERNEL);
 	if (!bufs)
 		return -ENOMEM;
 
-	fuse_copy_init(&cs, fc, 1, NULL, 0);
+	fuse_copy_init(&cs, chan->fc, 1, NULL, 0);
 	cs.pipebufs = bufs;
 	cs.pipe = pipe;
-	ret = fuse_dev_do_read(fc, in, &cs, len);
+	ret = fuse_dev_do_read(chan, in, &cs, len);
 	if (ret < 0)
 		goto out;
 
@@ -1494,13 +1671,17 @@ static int fuse_retrieve(struct fuse_conn *fc, struct inode *inode,
 	unsigned int num;
 	unsigned int offset;
 	size_t total_len = 0;
+	unsigned int num_pages;
 
-	req = fuse_get_req(fc);
+	offset = outarg->offset & ~PAGE_CACHE_MASK;
+	num_pages = (outarg->size + offset + PAGE_CACHE_SIZE - 1) >>
+		PAGE_CACHE_SHIFT;
+	num_pages = min(num_pages, fc->max_pages);
+
+	req = fuse_get_req(fc, num_pages);
 	if (IS_ERR(req))
 		return PTR_ERR(req);
 
-	offset = outarg->offset & ~PAGE_CACHE_MASK;
-
 	req->in.h.opcode = FUSE_NOTIFY_REPLY;
 	req->in.h.nodeid = outarg->nodeid;
 	req->in.numargs = 2;
@@ -1516,7 +1697,7 @@ static int fuse_retrieve(struct fuse_conn *fc, struct inode *inode,
 	else if (outarg->offset + num > file_size)
 		num = file_size - outarg->offset;
 
-	while (num && req->num_pages < FUSE_MAX_PAGES_PER_REQ) {
+	while (num && req->num_pages < num_pages) {
 		struct page *page;
 		unsigned int this_num;
 
@@ -1725,6 +1906,8 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 
 	err = copy_out_args(cs, &req->out, nbytes);
 	fuse_copy_finish(cs);
+	if (!err)
+		fuse_passthrough_setup(fc, req);
 
 	spin_lock(&fc->lock);
 	req->locked = 0;
@@ -1838,16 +2021,18 @@ out:
 static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 {
 	unsigned mask = POLLOUT | POLLWRNORM;
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
+	struct fuse_chan *chan = fuse_get_chan(file);
+	struct fuse_conn *fc;
+	if (!chan)
 		return POLLERR;
 
-	poll_wait(file, &fc->waitq, wait);
+	fc = chan->fc;
+	poll_wait(file, &chan->waitq, wait);
 
 	spin_lock(&fc->lock);
 	if (!fc->connected)
 		mask = POLLERR;
-	else if (request_pending(fc))
+	else if (request_pending(chan))
 		mask |= POLLIN | POLLRDNORM;
 	spin_unlock(&fc->lock);
 
@@ -1913,9 +2098,15 @@ static void end_queued_requests(struct fuse_conn *fc)
 __releases(fc->lock)
 __acquires(fc->lock)
 {
+	struct fuse_chan *chan;
+	LIST_HEAD(pending);
+
 	fc->max_background = UINT_MAX;
 	flush_bg_queue(fc);
-	end_requests(fc, &fc->pending);
+	/* end_requests() drops the lock, channels may go away meanwhile */
+	list_for_each_entry(chan, &fc->chans, entry)
+		list_splice_tail_init(&chan->pending, &pending);
+	end_requests(fc, &pending);
 	end_requests(fc, &fc->processing);
 	while (forget_pending(fc))
 		kfree(dequeue_forget(fc, 1, NULL));
@@ -1964,7 +2155,7 @@ void fuse_abort_conn(struct fuse_conn *fc)
 		end_io_requests(fc);
 		end_queued_requests(fc);
 		end_polls(fc);
-		wake_up_all(&fc->waitq);
+		fuse_wake_up_all(fc);
 		wake_up_all(&fc->blocked_waitq);
 		kill_fasync(&fc->fasync, SIGIO, POLL_IN);
 	}
@@ -1974,15 +2165,22 @@ EXPORT_SYMBOL_GPL(fuse_abort_conn);
 
 int fuse_dev_release(struct inode *inode, struct file *file)
 {
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (fc) {
+	struct fuse_chan *chan = fuse_get_chan(file);
+	if (chan) {
+		struct fuse_conn *fc = chan->fc;
+
 		spin_lock(&fc->lock);
-		fc->connected = 0;
-		fc->blocked = 0;
-		end_queued_requests(fc);
-		end_polls(fc);
-		wake_up_all(&fc->blocked_waitq);
+		/* Only the last channel going away ends the connection */
+		if (fc->nr_chans == 1) {
+			fc->connected = 0;
+			fc->blocked = 0;
+			end_queued_requests(fc);
+			end_polls(fc);
+			wake_up_all(&fc->blocked_waitq);
+		}
+		fuse_chan_remove(fc, chan);
 		spin_unlock(&fc->lock);
+		kfree(chan);
 		fuse_conn_put(fc);
 	}
 
@@ -1990,6 +2188,65 @@ int fuse_dev_release(struct inode *inode, struct file *file)
 }
 EXPORT_SYMBOL_GPL(fuse_dev_release);
 
+/*
+ * Attach @file, a freshly opened /dev/fuse, as a new channel of the
+ * connection that @oldfd belongs to
+ */
+static int fuse_dev_clone(struct file *file, int oldfd)
+{
+	struct fuse_chan *old_chan;
+	struct fuse_chan *chan;
+	struct file *old;
+	int err;
+
+	old = fget(oldfd);
+	if (!old)
+		return -EBADF;
+
+	err = -EINVAL;
+	if (old->f_op != &fuse_dev_operations ||
+	    file->f_op != &fuse_dev_operations)
+		goto out_fput;
+
+	mutex_lock(&fuse_mutex);
+	old_chan = fuse_get_chan(old);
+	if (!old_chan || file->private_data)
+		goto out_unlock;
+
+	err = -ENOMEM;
+	chan = fuse_chan_alloc(old_chan->fc);
+	if (!chan)
+		goto out_unlock;
+
+	fuse_conn_get(chan->fc);
+	fuse_chan_install(chan);
+	file->private_data = chan;
+	err = 0;
+
+ out_unlock:
+	mutex_unlock(&fuse_mutex);
+ out_fput:
+	fput(old);
+	return err;
+}
+
+static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
+			   unsigned long arg)
+{
+	u32 oldfd;
+
+	switch (cmd) {
+	case FUSE_DEV_IOC_CLONE:
+		if (get_user(oldfd, (u32 __user *) arg))
+			return -EFAULT;
+
+		return fuse_dev_clone(file, oldfd);
+
+	default:
+		return -ENOTTY;
+	}
+}
+
 static int fuse_dev_fasync(int fd, struct file *file, int on)
 {
 	struct fuse_conn *fc = fuse_get_conn(file);
@@ -2012,6 +2269,8 @@ const struct file_operations fuse_dev_operations = {
 	.poll		= fuse_dev_poll,
 	.release	= fuse_dev_release,
 	.fasync		= fuse_dev_fasync,
+	.unlocked_ioctl	= fuse_dev_ioctl,
+	.compat_ioctl	= fuse_dev_ioctl,
 };
 EXPORT_SYMBOL_GPL(fuse_dev_operations);
 
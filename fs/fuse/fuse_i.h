@@ -23,8 +23,16 @@
 #include <linux/poll.h>
 #include <linux/workqueue.h>
 
-/** Max number of pages that can be used in a single read request */
-#define FUSE_MAX_PAGES_PER_REQ 32
+#define FUSE_SUPER_MAGIC 0x65735546
+
+/** Default max number of pages that can be used in a single read request */
+#define FUSE_DEFAULT_MAX_PAGES_PER_REQ 32
+
+/** Maximum of max_pages the filesystem may ask for in INIT */
+#define FUSE_MAX_MAX_PAGES 256
+
+/** Number of page pointers embedded in fuse_req */
+#define FUSE_REQ_INLINE_PAGES 1
 
 /** Bias for fi->writectr, meaning new writepages must not be sent */
 #define FUSE_NOWRITE INT_MIN
@@ -136,6 +144,9 @@ struct fuse_file {
 	/** Wait queue head for poll */
 	wait_queue_head_t poll_wait;
 
+	/** Backing file for FOPEN_PASSTHROUGH, or NULL */
+	struct file *passthrough;
+
 	/** Has flock been performed on this file? */
 	bool flock:1;
 };
@@ -288,7 +299,13 @@ struct fuse_req {
 	} misc;
 
 	/** page vector */
-	struct page *pages[FUSE_MAX_PAGES_PER_REQ];
+	struct page **pages;
+
+	/** size of the 'pages' array */
+	unsigned max_pages;
+
+	/** inline page vector */
+	struct page *inline_pages[FUSE_REQ_INLINE_PAGES];
 
 	/** number of pages in vector */
 	unsigned num_pages;
@@ -310,6 +327,32 @@ struct fuse_req {
 
 	/** Request is stolen from fuse_file->reserved_req */
 	struct file *stolen_file;
+
+	/** Backing file handed over in an OPEN or CREATE reply */
+	struct file *passthrough;
+};
+
+/**
+ * A channel of a Fuse connection.
+ *
+ * Each open /dev/fuse file attached to a connection, the one given at
+ * mount time and any cloned from it with FUSE_DEV_IOC_CLONE, is a
+ * channel.  Requests are queued on the channel serving the CPU they
+ * are issued on, and readers take requests of other channels only
+ * when their own has none.
+ */
+struct fuse_chan {
+	/** The connection this channel belongs to */
+	struct fuse_conn *fc;
+
+	/** Readers of the channel are waiting on this */
+	wait_queue_head_t waitq;
+
+	/** The list of pending requests */
+	struct list_head pending;
+
+	/** Entry on fc->chans */
+	struct list_head entry;
 };
 
 /**
@@ -344,11 +387,17 @@ struct fuse_conn {
 	/** Maximum write size */
 	unsigned max_write;
 
-	/** Readers of the connection are waiting on this */
-	wait_queue_head_t waitq;
+	/** Maximum number of pages that can be used in a single request */
+	unsigned max_pages;
 
-	/** The list of pending requests */
-	struct list_head pending;
+	/** The channels of the connection */
+	struct list_head chans;
+
+	/** Number of channels */
+	unsigned nr_chans;
+
+	/** Channel queueing the requests of each CPU */
+	struct fuse_chan **cpu_chan;
 
 	/** The list of requests being processed */
 	struct list_head processing;
@@ -478,6 +527,9 @@ struct fuse_conn {
 	/** Are BSD file locking primitives not implemented by fs? */
 	unsigned no_flock:1;
 
+	/** May open replies ask for passthrough?  Only set in INIT */
+	unsigned passthrough:1;
+
 	/** The number of requests waiting for completion */
 	atomic_t num_waiting;
 
@@ -650,11 +702,11 @@ int fuse_ctl_init(void);
 void fuse_ctl_cleanup(void);
 
 /**
- * Allocate a request
+ * Allocate a request with room for @npages pages
  */
-struct fuse_req *fuse_request_alloc(void);
+struct fuse_req *fuse_request_alloc(unsigned npages);
 
-struct fuse_req *fuse_request_alloc_nofs(void);
+struct fuse_req *fuse_request_alloc_nofs(unsigned npages);
 
 /**
  * Free a request
@@ -662,9 +714,14 @@ struct fuse_req *fuse_request_alloc_nofs(void);
 void fuse_request_free(struct fuse_req *req);
 
 /**
- * Get a request, may fail with -ENOMEM
+ * Get a request with room for @npages pages, may fail with -ENOMEM
  */
-struct fuse_req *fuse_get_req(struct fuse_conn *fc);
+struct fuse_req *fuse_get_req(struct fuse_conn *fc, unsigned npages);
+
+static inline struct fuse_req *fuse_get_req_nopages(struct fuse_conn *fc)
+{
+	return fuse_get_req(fc, 0);
+}
 
 /**
  * Gets a requests for a file operation, always succeeds
@@ -693,6 +750,21 @@ void fuse_request_send_background_locked(struct fuse_conn *fc,
 /* Abort all requests */
 void fuse_abort_conn(struct fuse_conn *fc);
 
+/**
+ * Allocate a channel for the connection, not yet attached to it
+ */
+struct fuse_chan *fuse_chan_alloc(struct fuse_conn *fc);
+
+/**
+ * Attach a channel to its connection.  The channel takes over a
+ * reference to the connection, which is put when the device is
+ * released.
+ */
+void fuse_chan_install(struct fuse_chan *chan);
+
+/* Wake up all readers of the connection, called with fc->lock held */
+void fuse_wake_up_all(struct fuse_conn *fc);
+
 /**
  * Invalidate inode attributes
  */
@@ -773,4 +845,13 @@ int fuse_dev_release(struct inode *inode, struct file *file);
 
 void fuse_write_update_size(struct inode *inode, loff_t pos);
 
+/* passthrough.c */
+void fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_req *req);
+void fuse_passthrough_release(struct fuse_file *ff);
+ssize_t fuse_passthrough_aio_read(struct kiocb *iocb, const struct iovec *iov,
+				  unsigned long nr_segs, loff_t pos);
+ssize_t fuse_passthrough_aio_write(struct kiocb *iocb, const struct iovec *iov,
+				   unsigned long nr_segs, loff_t pos);
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma);
+
 #endif /* _FS_FUSE_I_H */
@@ -0,0 +1,212 @@
+/*
+  FUSE: Filesystem in Userspace
+  Passthrough of read, write and mmap to a backing file
+
+  This program can be distributed under the terms of the GNU GPL.
+  See the file COPYING.
+*/
+
+#include "fuse_i.h"
+
+#include <linux/file.h>
+#include <linux/aio.h>
+#include <linux/mm.h>
+#include <linux/uio.h>
+#include <linux/fsnotify.h>
+
+/*
+ * Called in the context of the filesystem daemon, while it writes the
+ * reply to an OPEN or CREATE request, so that open_out.passthrough_fd
+ * can be looked up in its file table.  If the file can't be used, the
+ * FOPEN_PASSTHROUGH flag is dropped and the file is opened normally.
+ */
+void fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_req *req)
+{
+	struct fuse_open_out *outarg;
+	struct file *backing, *file;
+	struct inode *inode;
+
+	if (req->out.h.error)
+		return;
+
+	switch (req->in.h.opcode) {
+	case FUSE_OPEN:
+		outarg = req->out.args[0].value;
+		break;
+	case FUSE_CREATE:
+		outarg = req->out.args[1].value;
+		break;
+	default:
+		return;
+	}
+
+	if (!(outarg->open_flags & FOPEN_PASSTHROUGH))
+		return;
+
+	if (!fc->passthrough)
+		goto out_clear;
+
+	backing = fget(outarg->passthrough_fd);
+	if (!backing)
+		goto out_clear;
+
+	inode = backing->f_path.dentry->d_inode;
+	/* No stacking on top of another fuse file */
+	if (!S_ISREG(inode->i_mode) ||
+	    inode->i_sb->s_magic == FUSE_SUPER_MAGIC ||
+	    !backing->f_op || !backing->f_op->aio_read ||
+	    !backing->f_op->aio_write) {
+		fput(backing);
+		goto out_clear;
+	}
+
+	/*
+	 * Use a file of our own on the backing inode, opened like the
+	 * daemon's, so that its O_APPEND can follow the fuse file's.
+	 */
+	file = dentry_open(dget(backing->f_path.dentry),
+			   mntget(backing->f_path.mnt), backing->f_flags,
+			   backing->f_cred);
+	fput(backing);
+	if (IS_ERR(file))
+		goto out_clear;
+
+	req->passthrough = file;
+	return;
+
+ out_clear:
+	outarg->open_flags &= ~FOPEN_PASSTHROUGH;
+}
+
+void fuse_passthrough_release(struct fuse_file *ff)
+{
+	if (ff->passthrough) {
+		fput(ff->passthrough);
+		ff->passthrough = NULL;
+	}
+}
+
+/*
+ * The iovec has been copied from userspace already, so vfs_readv() and
+ * vfs_writev() can't be used: do their checks and notifications on the
+ * backing file here.
+ */
+static ssize_t fuse_passthrough_rw(struct file *backing, struct kiocb *iocb,
+				   const struct iovec *iov,
+				   unsigned long nr_segs, loff_t pos,
+				   int write)
+{
+	size_t count = iov_length(iov, nr_segs);
+	struct kiocb kiocb;
+	ssize_t ret;
+
+	ret = rw_verify_area(write ? WRITE : READ, backing, &pos, count);
+	if (ret < 0)
+		return ret;
+
+	init_sync_kiocb(&kiocb, backing);
+	kiocb.ki_pos = pos;
+	kiocb.ki_left = count;
+	kiocb.ki_nbytes = count;
+
+	if (write)
+		ret = backing->f_op->aio_write(&kiocb, iov, nr_segs,
+					       kiocb.ki_pos);
+	else
+		ret = backing->f_op->aio_read(&kiocb, iov, nr_segs,
+					      kiocb.ki_pos);
+	if (ret == -EIOCBQUEUED)
+		ret = wait_on_sync_kiocb(&kiocb);
+
+	if (ret > 0) {
+		if (write)
+			fsnotify_modify(backing);
+		else
+			fsnotify_access(backing);
+	}
+
+	iocb->ki_pos = kiocb.ki_pos;
+	return ret;
+}
+
+ssize_t fuse_passthrough_aio_read(struct kiocb *iocb, const struct iovec *iov,
+				  unsigned long nr_segs, loff_t pos)
+{
+	struct fuse_file *ff = iocb->ki_filp->private_data;
+	struct file *backing = ff->passthrough;
+
+	if (!(backing->f_mode & FMODE_READ))
+		return -EBADF;
+
+	return fuse_passthrough_rw(backing, iocb, iov, nr_segs, pos, 0);
+}
+
+ssize_t fuse_passthrough_aio_write(struct kiocb *iocb, const struct iovec *iov,
+				   unsigned long nr_segs, loff_t pos)
+{
+	struct file *file = iocb->ki_filp;
+	struct fuse_file *ff = file->private_data;
+	struct file *backing = ff->passthrough;
+	struct inode *inode = file->f_mapping->host;
+	ssize_t ret;
+
+	if (!(backing->f_mode & FMODE_WRITE))
+		return -EBADF;
+
+	mutex_lock(&inode->i_mutex);
+	/*
+	 * Our i_size may be stale: with O_APPEND, let the backing file's
+	 * aio_write find the end of the file, under its own lock.
+	 */
+	if ((file->f_flags ^ backing->f_flags) & O_APPEND) {
+		spin_lock(&backing->f_lock);
+		backing->f_flags ^= O_APPEND;
+		spin_unlock(&backing->f_lock);
+	}
+
+	ret = fuse_passthrough_rw(backing, iocb, iov, nr_segs, pos, 1);
+	if (ret > 0)
+		fuse_write_update_size(inode, iocb->ki_pos);
+	mutex_unlock(&inode->i_mutex);
+
+	fuse_invalidate_attr(inode);
+
+	return ret;
+}
+
+/*
+ * Map the backing file instead: the vma takes a reference to it and
+ * drops the one to the fuse file, so faults never reach fuse.
+ */
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct fuse_file *ff = file->private_data;
+	struct file *backing = ff->passthrough;
+	int ret;
+
+	if (WARN_ON(vma->vm_file != file))
+		return -EIO;
+
+	if (!backing->f_op->mmap)
+		return -ENODEV;
+
+	if (!(backing->f_mode & FMODE_READ))
+		return -EACCES;
+	if ((vma->vm_flags & VM_SHARED) && !(backing->f_mode & FMODE_WRITE)) {
+		if (vma->vm_flags & VM_WRITE)
+			return -EACCES;
+		vma->vm_flags &= ~VM_MAYWRITE;
+	}
+
+	get_file(backing);
+	vma->vm_file = backing;
+	ret = backing->f_op->mmap(backing, vma);
+	if (ret) {
+		vma->vm_file = file;
+		fput(backing);
+	} else {
+		fput(file);
+	}
+
+	return ret;
+}
@@ -42,6 +42,7 @@
 #include <linux/log2.h>
 #include <linux/vmalloc.h>
 #include <linux/backing-dev.h>
+#include <linux/blkdev.h>
 #include <linux/bitops.h>
 #include <linux/ratelimit.h>
 
@@ -76,6 +77,10 @@ EXPORT_SYMBOL(jbd2_journal_check_used_features);
 EXPORT_SYMBOL(jbd2_journal_check_available_features);
 EXPORT_SYMBOL(jbd2_journal_set_features);
 EXPORT_SYMBOL(jbd2_journal_load);
+EXPORT_SYMBOL(jbd2_fc_init);
+EXPORT_SYMBOL(jbd2_fc_release);
+EXPORT_SYMBOL(jbd2_fc_get_buf);
+EXPORT_SYMBOL(jbd2_fc_write_buf);
 EXPORT_SYMBOL(jbd2_journal_destroy);
 EXPORT_SYMBOL(jbd2_journal_abort);
 EXPORT_SYMBOL(jbd2_journal_errno);
@@ -1092,13 +1097,26 @@ static void journal_fail_superblock (journal_t *journal)
  * subsequent use.
  */
 
+/* The log ends where the fast commit area, if there is one, begins. */
+static void journal_set_fc_area(journal_t *journal)
+{
+	journal_superblock_t *sb = journal->j_superblock;
+
+	journal->j_fc_first = be32_to_cpu(sb->s_maxlen);
+	journal->j_fc_last = journal->j_fc_first;
+	if (JBD2_HAS_INCOMPAT_FEATURE(journal,
+				      JBD2_FEATURE_INCOMPAT_FAST_COMMIT))
+		journal->j_fc_first -= be32_to_cpu(sb->s_num_fc_blks);
+}
+
 static int journal_reset(journal_t *journal)
 {
 	journal_superblock_t *sb = journal->j_superblock;
 	unsigned long long first, last;
 
+	journal_set_fc_area(journal);
 	first = be32_to_cpu(sb->s_first);
-	last = be32_to_cpu(sb->s_maxlen);
+	last = journal->j_fc_first;
 	if (first + JBD2_MIN_JOURNAL_BLOCKS > last + 1) {
 		printk(KERN_ERR "JBD: Journal too short (blocks %llu-%llu).\n",
 		       first, last);
@@ -1117,7 +1135,8 @@ static int journal_reset(journal_t *journal)
 	journal->j_commit_sequence = journal->j_transaction_sequence - 1;
 	journal->j_commit_request = journal->j_commit_sequence;
 
-	journal->j_max_transaction_buffers = journal->j_maxlen / 4;
+	journal->j_max_transaction_buffers = (journal->j_maxlen -
+		(journal->j_fc_last - journal->j_fc_first)) / 4;
 
 	/* Add the dynamic fields and write it to disk. */
 	jbd2_journal_update_superblock(journal, 1);
@@ -1266,6 +1285,16 @@ static int journal_get_superblock(journal_t *journal)
 		goto out;
 	}
 
+	if (JBD2_HAS_INCOMPAT_FEATURE(journal,
+				      JBD2_FEATURE_INCOMPAT_FAST_COMMIT) &&
+	    be32_to_cpu(sb->s_num_fc_blks) >=
+	    journal->j_maxlen - be32_to_cpu(sb->s_first)) {
+		printk(KERN_WARNING
+			"JBD2: Invalid fast commit area size: %u\n",
+			be32_to_cpu(sb->s_num_fc_blks));
+		goto out;
+	}
+
 	return 0;
 
 out:
@@ -1292,7 +1321,8 @@ static int load_superblock(journal_t *journal)
 	journal->j_tail_sequence = be32_to_cpu(sb->s_sequence);
 	journal->j_tail = be32_to_cpu(sb->s_start);
 	journal->j_first = be32_to_cpu(sb->s_first);
-	journal->j_last = be32_to_cpu(sb->s_maxlen);
+	journal_set_fc_area(journal);
+	journal->j_last = journal->j_fc_first;
 	journal->j_errno = be32_to_cpu(sb->s_errno);
 
 	return 0;
@@ -1365,6 +1395,209 @@ recovery_error:
 	return -EIO;
 }
 
+/*
+ * Zero the @blocks journal blocks from @first on and wait for them to be
+ * on stable storage.  Used before they become the fast commit area, so
+ * that recovery can't take whatever the log left there for a record.
+ */
+static int journal_zero_fc_area(journal_t *journal, unsigned long first,
+				unsigned int blocks)
+{
+	struct buffer_head **bhs;
+	unsigned long long blocknr;
+	unsigned int i, nr = 0;
+	int err = 0;
+
+	bhs = kcalloc(blocks, sizeof(*bhs), GFP_KERNEL);
+	if (!bhs)
+		return -ENOMEM;
+
+	for (i = 0; i < blocks; i++) {
+		err = jbd2_journal_bmap(journal, first + i, &blocknr);
+		if (err)
+			break;
+		bhs[nr] = __getblk(journal->j_dev, blocknr,
+				   journal->j_blocksize);
+		if (!bhs[nr]) {
+			err = -ENOMEM;
+			break;
+		}
+		lock_buffer(bhs[nr]);
+		memset(bhs[nr]->b_data, 0, journal->j_blocksize);
+		set_buffer_uptodate(bhs[nr]);
+		unlock_buffer(bhs[nr]);
+		mark_buffer_dirty(bhs[nr]);
+		write_dirty_buffer(bhs[nr], WRITE);
+		nr++;
+	}
+
+	for (i = 0; i < nr; i++) {
+		wait_on_buffer(bhs[i]);
+		if (!buffer_uptodate(bhs[i]))
+			err = -EIO;
+		brelse(bhs[i]);
+	}
+	kfree(bhs);
+
+	if (!err && (journal->j_flags & JBD2_BARRIER))
+		err = blkdev_issue_flush(journal->j_dev, GFP_KERNEL, NULL);
+	return err;
+}
+
+/**
+ * int jbd2_fc_init() - Set aside a fast commit area at the end of the journal
+ * @journal: Journal to act on.
+ * @blocks: size of the area
+ *
+ * Has to be called right after jbd2_journal_load(), while the log is still
+ * empty.  A journal that already has a fast commit area keeps it as it is.
+ * The area is zeroed first, then made known to recovery with an
+ * incompatible feature.
+ */
+int jbd2_fc_init(journal_t *journal, unsigned int blocks)
+{
+	journal_superblock_t *sb = journal->j_superblock;
+	int err = 0;
+
+	if (JBD2_HAS_INCOMPAT_FEATURE(journal,
+				      JBD2_FEATURE_INCOMPAT_FAST_COMMIT))
+		return 0;
+
+	/* leave the log at least three quarters of the journal */
+	if (blocks > (journal->j_last - journal->j_first) / 4 ||
+	    journal->j_first + JBD2_MIN_JOURNAL_BLOCKS >
+	    journal->j_last - blocks + 1)
+		return -ENOSPC;
+
+	/*
+	 * The log is empty, so nothing is written to its last blocks
+	 * while they are zeroed; if a commit comes in meanwhile, the
+	 * checks below fail and the feature is not set.
+	 */
+	err = journal_zero_fc_area(journal, journal->j_maxlen - blocks,
+				   blocks);
+	if (err)
+		return err;
+
+	write_lock(&journal->j_state_lock);
+	if (journal->j_running_transaction ||
+	    journal->j_committing_transaction ||
+	    journal->j_head != journal->j_first ||
+	    journal->j_tail != journal->j_first) {
+		err = -EBUSY;
+		goto out;
+	}
+	if (!jbd2_journal_set_features(journal, 0, 0,
+				       JBD2_FEATURE_INCOMPAT_FAST_COMMIT)) {
+		err = -EINVAL;
+		goto out;
+	}
+
+	sb->s_num_fc_blks = cpu_to_be32(blocks);
+	journal_set_fc_area(journal);
+	journal->j_last = journal->j_fc_first;
+	journal->j_free = journal->j_last - journal->j_first;
+	journal->j_max_transaction_buffers = (journal->j_maxlen - blocks) / 4;
+out:
+	write_unlock(&journal->j_state_lock);
+	if (err)
+		return err;
+
+	mark_buffer_dirty(journal->j_sb_buffer);
+	return sync_dirty_buffer(journal->j_sb_buffer);
+}
+
+/**
+ * int jbd2_fc_release() - Give the fast commit area back to the log
+ * @journal: Journal to act on.
+ *
+ * Has to be called right after jbd2_journal_load(), while the log is still
+ * empty.  Clears the incompatible feature again, so that the journal can
+ * be used by code that does not know about fast commits.
+ */
+int jbd2_fc_release(journal_t *journal)
+{
+	journal_superblock_t *sb = journal->j_superblock;
+	int err = 0;
+
+	if (!JBD2_HAS_INCOMPAT_FEATURE(journal,
+				       JBD2_FEATURE_INCOMPAT_FAST_COMMIT))
+		return 0;
+
+	write_lock(&journal->j_state_lock);
+	if (journal->j_running_transaction ||
+	    journal->j_committing_transaction ||
+	    journal->j_head != journal->j_first ||
+	    journal->j_tail != journal->j_first) {
+		err = -EBUSY;
+		goto out;
+	}
+
+	jbd2_journal_clear_features(journal, 0, 0,
+				    JBD2_FEATURE_INCOMPAT_FAST_COMMIT);
+	sb->s_num_fc_blks = 0;
+	journal_set_fc_area(journal);
+	journal->j_last = journal->j_fc_first;
+	journal->j_free = journal->j_last - journal->j_first;
+	journal->j_max_transaction_buffers = journal->j_maxlen / 4;
+out:
+	write_unlock(&journal->j_state_lock);
+	if (err)
+		return err;
+
+	mark_buffer_dirty(journal->j_sb_buffer);
+	return sync_dirty_buffer(journal->j_sb_buffer);
+}
+
+/**
+ * struct buffer_head *jbd2_fc_get_buf() - Get a block of the fast commit area
+ * @journal: Journal to act on.
+ * @off: offset of the block in the area
+ *
+ * Returns the buffer, not read in, or NULL if @off is past the area.
+ */
+struct buffer_head *jbd2_fc_get_buf(journal_t *journal, unsigned int off)
+{
+	unsigned long long blocknr;
+
+	if (off >= journal->j_fc_last - journal->j_fc_first)
+		return NULL;
+	if (jbd2_journal_bmap(journal, journal->j_fc_first + off, &blocknr))
+		return NULL;
+	return __getblk(journal->j_dev, blocknr, journal->j_blocksize);
+}
+
+/**
+ * int jbd2_fc_write_buf() - Write a block of the fast commit area
+ * @journal: Journal to act on.
+ * @bh: the block, from jbd2_fc_get_buf()
+ *
+ * Writes @bh and waits for it.  With barriers, everything the filesystem
+ * has written before is on stable storage first, and so is @bh when this
+ * returns.
+ */
+int jbd2_fc_write_buf(journal_t *journal, struct buffer_head *bh)
+{
+	int op = WRITE_SYNC;
+
+	if (journal->j_flags & JBD2_BARRIER) {
+		if (journal->j_fs_dev != journal->j_dev)
+			blkdev_issue_flush(journal->j_fs_dev, GFP_NOFS, NULL);
+		op = WRITE_FLUSH_FUA;
+	}
+
+	lock_buffer(bh);
+	clear_buffer_dirty(bh);
+	set_buffer_uptodate(bh);
+	get_bh(bh);
+	bh->b_end_io = end_buffer_write_sync;
+	submit_bh(op, bh);
+	wait_on_buffer(bh);
+	if (!buffer_uptodate(bh))
+		return -EIO;
+	return 0;
+}
+
 /**
  * void jbd2_journal_destroy() - Release a journal_t structure.
  * @journal: Journal to act on.
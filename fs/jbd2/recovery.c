@@ -210,6 +210,30 @@ do {									\
 		var -= ((journal)->j_last - (journal)->j_first);	\
 } while (0)
 
+/*
+ * Hand the blocks of the fast commit area to the client in order, along
+ * with the ID of the transaction that was running when the log ended:
+ * only records written during that one are still of use.
+ */
+static int fc_do_replay(journal_t *journal, tid_t tid)
+{
+	struct buffer_head *bh;
+	unsigned int off;
+	int err = 0;
+
+	for (off = 0; off < journal->j_fc_last - journal->j_fc_first; off++) {
+		err = jread(&bh, journal, journal->j_fc_first + off);
+		if (err)
+			break;
+		err = journal->j_fc_replay_callback(journal, bh, off, tid);
+		brelse(bh);
+		if (err)
+			break;
+	}
+
+	return err < 0 ? err : 0;
+}
+
 /**
  * jbd2_journal_recover - recovers a on-disk journal
  * @journal: the journal to recover
@@ -250,6 +274,10 @@ int jbd2_journal_recover(journal_t *journal)
 		err = do_one_pass(journal, &info, PASS_REVOKE);
 	if (!err)
 		err = do_one_pass(journal, &info, PASS_REPLAY);
+	if (!err && journal->j_fc_replay_callback &&
+	    JBD2_HAS_INCOMPAT_FEATURE(journal,
+				      JBD2_FEATURE_INCOMPAT_FAST_COMMIT))
+		err = fc_do_replay(journal, info.end_transaction);
 
 	jbd_debug(1, "JBD: recovery, exit status %d, "
 		  "recovered transactions %u to %u\n",
@@ -52,6 +52,7 @@
 #include "squashfs_fs_sb.h"
 #include "squashfs_fs_i.h"
 #include "squashfs.h"
+#include "page_actor.h"
 
 /*
  * Locate cache slot in range [offset, index] for specified inode.  If
@@ -371,11 +372,119 @@ static int read_blocklist(struct inode *inode, int index, u64 *block)
 }
 
 
+/*
+ * Decompress the datablock at @block, holding @bytes of file data, straight
+ * into the page cache pages it covers, from index @start on, saving the
+ * copy out of the read_page cache.  @page has an entry for each of those
+ * pages: the ones the caller holds locked already, NULL for the others,
+ * which are grabbed here.  That needs every one of the pages: if one
+ * cannot be grabbed without waiting, or is uptodate already, -EAGAIN is
+ * returned so that the caller can go through the cache instead.
+ *
+ * Pages grabbed here are unlocked and released again, the caller's are
+ * left locked, uptodate only if 0 is returned.
+ */
+static int squashfs_read_block_direct(struct address_space *mapping,
+	struct page **page, pgoff_t start, u64 block, int bsize, int bytes)
+{
+	struct squashfs_sb_info *msblk = mapping->host->i_sb->s_fs_info;
+	int pages = (bytes + PAGE_CACHE_SIZE - 1) >> PAGE_CACHE_SHIFT;
+	DECLARE_BITMAP(grabbed, 1 << (SQUASHFS_FILE_MAX_LOG - PAGE_CACHE_SHIFT));
+	struct squashfs_page_actor actor;
+	void *pageaddr;
+	int i, res = -EAGAIN;
+
+	bitmap_zero(grabbed, pages);
+
+	for (i = 0; i < pages; i++) {
+		if (page[i])
+			continue;
+		page[i] = grab_cache_page_nowait(mapping, start + i);
+		if (page[i] == NULL)
+			goto release_pages;
+		__set_bit(i, grabbed);
+		if (PageUptodate(page[i]))
+			goto release_pages;
+	}
+
+	/* the pages are mapped one at a time, as they are filled */
+	squashfs_actor_init_page(&actor, page, pages);
+	res = squashfs_read_data(mapping->host->i_sb, &actor, block, bsize,
+		NULL, pages << PAGE_CACHE_SHIFT);
+	if (res >= 0 && res != bytes) {
+		ERROR("Datablock @ %llx decompressed to %d bytes, expected %d\n",
+			block, res, bytes);
+		res = -EIO;
+	}
+	if (res >= 0 && (bytes & (PAGE_CACHE_SIZE - 1))) {
+		pageaddr = kmap_atomic(page[pages - 1], KM_USER0);
+		memset(pageaddr + (bytes & (PAGE_CACHE_SIZE - 1)), 0,
+			PAGE_CACHE_SIZE - (bytes & (PAGE_CACHE_SIZE - 1)));
+		kunmap_atomic(pageaddr, KM_USER0);
+	}
+
+	for (i = 0; i < pages; i++) {
+		if (res < 0)
+			continue;
+		flush_dcache_page(page[i]);
+		SetPageUptodate(page[i]);
+	}
+
+	if (res >= 0) {
+		atomic_long_inc(&msblk->direct_reads);
+		res = 0;
+	}
+
+release_pages:
+	/* pages not made uptodate are left to be read again */
+	for (i = 0; i < pages; i++) {
+		if (!test_bit(i, grabbed))
+			continue;
+		if (page[i]) {
+			unlock_page(page[i]);
+			page_cache_release(page[i]);
+		}
+		page[i] = NULL;
+	}
+	return res;
+}
+
+
+/*
+ * Fill @target_page, and the other pages of its datablock, straight from
+ * the datablock.  On failure @target_page is left locked.
+ */
+static int squashfs_readpage_direct(struct page *target_page, u64 block,
+	int bsize, int bytes)
+{
+	struct squashfs_sb_info *msblk =
+		target_page->mapping->host->i_sb->s_fs_info;
+	int mask = (1 << (msblk->block_log - PAGE_CACHE_SHIFT)) - 1;
+	pgoff_t start = target_page->index & ~mask;
+	int pages = (bytes + PAGE_CACHE_SIZE - 1) >> PAGE_CACHE_SHIFT;
+	struct page **page;
+	int res;
+
+	page = kcalloc(pages, sizeof(*page), GFP_KERNEL);
+	if (page == NULL)
+		return -EAGAIN;
+
+	page[target_page->index - start] = target_page;
+	res = squashfs_read_block_direct(target_page->mapping, page, start,
+		block, bsize, bytes);
+	if (res == 0)
+		unlock_page(target_page);
+
+	kfree(page);
+	return res;
+}
+
+
 static int squashfs_readpage(struct file *file, struct page *page)
 {
 	struct inode *inode = page->mapping->host;
 	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
-	int bytes, i, offset = 0, sparse = 0;
+	int bytes, i, offset = 0, sparse = 0, res;
 	struct squashfs_cache_entry *buffer = NULL;
 	void *pageaddr;
 
@@ -409,6 +518,17 @@ static int squashfs_readpage(struct file *file, struct page *page)
 				 msblk->block_size;
 			sparse = 1;
 		} else {
+			bytes = index == file_end ?
+				(i_size_read(inode) & (msblk->block_size - 1)) :
+				 msblk->block_size;
+			res = squashfs_readpage_direct(page, block, bsize,
+				bytes);
+			if (res == 0)
+				return 0;
+			if (res != -EAGAIN)
+				goto error_out;
+			atomic_long_inc(&msblk->direct_fallbacks);
+
 			/*
 			 * Read and decompress datablock.
 			 */
@@ -496,6 +616,95 @@ out:
 }
 
 
+#define list_to_page(head) (list_entry((head)->prev, struct page, lru))
+
+/*
+ * Readahead.  The block list of the window is looked up and the reads of
+ * all its datablocks are started at once, then the blocks are
+ * decompressed in order as their reads complete, each straight into its
+ * pages when possible: the readahead pages of the block are put into the
+ * page cache and the ones missing grabbed as in squashfs_readpage().
+ * Pages in the fragment or in holes, and blocks that cannot be read
+ * directly, go through squashfs_readpage().
+ */
+static int squashfs_readpages(struct file *file, struct address_space *mapping,
+	struct list_head *pages, unsigned nr_pages)
+{
+	struct inode *inode = mapping->host;
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	int shift = msblk->block_log - PAGE_CACHE_SHIFT;
+	int file_end = i_size_read(inode) >> msblk->block_log;
+	int fragment = squashfs_i(inode)->fragment_block != SQUASHFS_INVALID_BLK;
+	struct page **page, *p;
+	int index, last = -1;
+	u64 block;
+	int bsize;
+
+	page = kmalloc(sizeof(*page) << shift, GFP_KERNEL);
+	if (page == NULL)
+		return -ENOMEM;
+
+	list_for_each_entry_reverse(p, pages, lru) {
+		index = p->index >> shift;
+		if (index == last || (fragment && index >= file_end))
+			continue;
+		last = index;
+		bsize = read_blocklist(inode, index, &block);
+		if (bsize > 0) {
+			squashfs_prefetch_block(inode->i_sb, block, bsize);
+			atomic_long_inc(&msblk->readahead_blocks);
+		}
+	}
+
+	while (!list_empty(pages)) {
+		pgoff_t start;
+		int i, bytes, res = -EAGAIN;
+
+		index = list_to_page(pages)->index >> shift;
+		start = (pgoff_t) index << shift;
+		memset(page, 0, sizeof(*page) << shift);
+
+		/* the readahead pages of this block, in index order */
+		while (!list_empty(pages)) {
+			p = list_to_page(pages);
+			if (p->index >> shift != index)
+				break;
+			list_del(&p->lru);
+			if (add_to_page_cache_lru(p, mapping, p->index,
+							GFP_KERNEL)) {
+				page_cache_release(p);
+				continue;
+			}
+			page[p->index - start] = p;
+		}
+
+		if (!fragment || index < file_end) {
+			bsize = read_blocklist(inode, index, &block);
+			bytes = index == file_end ?
+				(i_size_read(inode) & (msblk->block_size - 1)) :
+				 msblk->block_size;
+			if (bsize > 0)
+				res = squashfs_read_block_direct(mapping, page,
+					start, block, bsize, bytes);
+		}
+
+		for (i = 0; i < 1 << shift; i++) {
+			if (page[i] == NULL)
+				continue;
+			if (res == 0)
+				unlock_page(page[i]);
+			else
+				squashfs_readpage(file, page[i]);
+			page_cache_release(page[i]);
+		}
+	}
+
+	kfree(page);
+	return 0;
+}
+
+
 const struct address_space_operations squashfs_aops = {
-	.readpage = squashfs_readpage
+	.readpage = squashfs_readpage,
+	.readpages = squashfs_readpages
 };
@@ -36,6 +36,10 @@
 #include <linux/module.h>
 #include <linux/magic.h>
 #include <linux/xattr.h>
+#include <linux/parser.h>
+#include <linux/seq_file.h>
+#include <linux/mount.h>
+#include <linux/proc_fs.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
@@ -46,6 +50,58 @@
 
 static struct file_system_type squashfs_fs_type;
 static const struct super_operations squashfs_super_ops;
+static struct proc_dir_entry *squashfs_proc_root;
+
+enum {
+	Opt_threads_single, Opt_threads_percpu, Opt_threads, Opt_err
+};
+
+static const match_table_t squashfs_tokens = {
+	{Opt_threads_single, "threads=single"},
+	{Opt_threads_percpu, "threads=percpu"},
+	{Opt_threads, "threads=%s"},
+	{Opt_err, NULL}
+};
+
+
+/*
+ * Squashfs used to ignore all mount options, so options it does not
+ * know are still only warned about rather than failing the mount.
+ */
+static int squashfs_parse_options(struct squashfs_sb_info *msblk,
+	char *options)
+{
+	substring_t args[MAX_OPT_ARGS];
+	char *p;
+
+	msblk->thread_ops = &squashfs_decompressor_single;
+
+	if (!options)
+		return 0;
+
+	while ((p = strsep(&options, ",")) != NULL) {
+		if (!*p)
+			continue;
+
+		switch (match_token(p, squashfs_tokens, args)) {
+		case Opt_threads_single:
+			msblk->thread_ops = &squashfs_decompressor_single;
+			break;
+		case Opt_threads_percpu:
+			msblk->thread_ops = &squashfs_decompressor_percpu;
+			break;
+		case Opt_threads:
+			ERROR("Unknown decompressor threads mode %s\n", p);
+			return -EINVAL;
+		default:
+			WARNING("Ignoring mount option \"%s\"\n", p);
+			break;
+		}
+	}
+
+	return 0;
+}
+
 
 static const struct squashfs_decompressor *supported_squashfs_filesystem(short
 	major, short minor, short id)
@@ -74,6 +130,43 @@ static const struct squashfs_decompressor *supported_squashfs_filesystem(short
 }
 
 
+/*
+ * /proc/fs/squashfs/<dev>/stats: how many datablocks were decompressed
+ * straight into the page cache, and how many had to go through the
+ * read_page cache because not all their pages could be grabbed.
+ */
+static int squashfs_stats_show(struct seq_file *m, void *v)
+{
+	struct squashfs_sb_info *msblk = m->private;
+	unsigned long direct = atomic_long_read(&msblk->direct_reads);
+	unsigned long fallbacks = atomic_long_read(&msblk->direct_fallbacks);
+
+	seq_printf(m, "direct_reads: %lu\n", direct);
+	seq_printf(m, "direct_fallbacks: %lu\n", fallbacks);
+	seq_printf(m, "direct_hit_percent: %lu\n", direct + fallbacks ?
+		direct * 100 / (direct + fallbacks) : 0);
+	seq_printf(m, "readahead_blocks: %lu\n",
+		atomic_long_read(&msblk->readahead_blocks));
+
+	return 0;
+}
+
+
+static int squashfs_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, squashfs_stats_show, PDE(inode)->data);
+}
+
+
+static const struct file_operations squashfs_stats_fops = {
+	.owner = THIS_MODULE,
+	.open = squashfs_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release
+};
+
+
 static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 {
 	struct squashfs_sb_info *msblk;
@@ -98,9 +191,12 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 	msblk->devblksize = sb_min_blocksize(sb, BLOCK_SIZE);
 	msblk->devblksize_log2 = ffz(~msblk->devblksize);
 
-	mutex_init(&msblk->read_data_mutex);
 	mutex_init(&msblk->meta_index_mutex);
 
+	err = squashfs_parse_options(msblk, data);
+	if (err)
+		goto failed_mount;
+
 	/*
 	 * msblk->bytes_used is checked in squashfs_read_table to ensure reads
 	 * are not beyond filesystem end.  But as we're using
@@ -200,8 +296,9 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 	if (msblk->block_cache == NULL)
 		goto failed_mount;
 
-	/* Allocate read_page block */
-	msblk->read_page = squashfs_cache_init("data", 1, msblk->block_size);
+	/* Allocate read_page blocks, one for each concurrent decompressor */
+	msblk->read_page = squashfs_cache_init("data",
+		squashfs_max_decompressors(msblk), msblk->block_size);
 	if (msblk->read_page == NULL) {
 		ERROR("Failed to allocate read_page block\n");
 		goto failed_mount;
@@ -324,6 +421,12 @@ check_directory_table:
 		goto failed_mount;
 	}
 
+	if (squashfs_proc_root)
+		msblk->proc_dir = proc_mkdir(sb->s_id, squashfs_proc_root);
+	if (msblk->proc_dir)
+		proc_create_data("stats", S_IRUGO, msblk->proc_dir,
+			&squashfs_stats_fops, msblk);
+
 	TRACE("Leaving squashfs_fill_super\n");
 	kfree(sblk);
 	return 0;
@@ -332,7 +435,7 @@ failed_mount:
 	squashfs_cache_delete(msblk->block_cache);
 	squashfs_cache_delete(msblk->fragment_cache);
 	squashfs_cache_delete(msblk->read_page);
-	squashfs_decompressor_free(msblk, msblk->stream);
+	squashfs_decompressor_free(msblk);
 	kfree(msblk->inode_lookup_table);
 	kfree(msblk->fragment_index);
 	kfree(msblk->id_table);
@@ -365,6 +468,17 @@ static int squashfs_statfs(struct dentry *dentry, struct kstatfs *buf)
 }
 
 
+static int squashfs_show_options(struct seq_file *seq, struct vfsmount *mnt)
+{
+	struct squashfs_sb_info *msblk = mnt->mnt_sb->s_fs_info;
+
+	if (msblk->thread_ops != &squashfs_decompressor_single)
+		seq_printf(seq, ",threads=%s", msblk->thread_ops->name);
+
+	return 0;
+}
+
+
 static int squashfs_remount(struct super_block *sb, int *flags, char *data)
 {
 	*flags |= MS_RDONLY;
@@ -376,10 +490,14 @@ static void squashfs_put_super(struct super_block *sb)
 {
 	if (sb->s_fs_info) {
 		struct squashfs_sb_info *sbi = sb->s_fs_info;
+		if (sbi->proc_dir) {
+			remove_proc_entry("stats", sbi->proc_dir);
+			remove_proc_entry(sb->s_id, squashfs_proc_root);
+		}
 		squashfs_cache_delete(sbi->block_cache);
 		squashfs_cache_delete(sbi->fragment_cache);
 		squashfs_cache_delete(sbi->read_page);
-		squashfs_decompressor_free(sbi, sbi->stream);
+		squashfs_decompressor_free(sbi);
 		kfree(sbi->id_table);
 		kfree(sbi->fragment_index);
 		kfree(sbi->meta_index);
@@ -432,8 +550,12 @@ static int __init init_squashfs_fs(void)
 	if (err)
 		return err;
 
+	squashfs_proc_root = proc_mkdir("fs/squashfs", NULL);
+
 	err = register_filesystem(&squashfs_fs_type);
 	if (err) {
+		if (squashfs_proc_root)
+			remove_proc_entry("fs/squashfs", NULL);
 		destroy_inodecache();
 		return err;
 	}
@@ -448,6 +570,8 @@ static int __init init_squashfs_fs(void)
 static void __exit exit_squashfs_fs(void)
 {
 	unregister_filesystem(&squashfs_fs_type);
+	if (squashfs_proc_root)
+		remove_proc_entry("fs/squashfs", NULL);
 	destroy_inodecache();
 }
 
@@ -486,6 +610,7 @@ static const struct super_operations squashfs_super_ops = {
 	.alloc_inode = squashfs_alloc_inode,
 	.destroy_inode = squashfs_destroy_inode,
 	.statfs = squashfs_statfs,
+	.show_options = squashfs_show_options,
 	.put_super = squashfs_put_super,
 	.remount_fs = squashfs_remount
 };
@@ -93,6 +93,18 @@ struct backing_dev_info {
 
 	struct timer_list laptop_mode_wb_timer;
 
+	/* read latency targeted throttling of background writes */
+	unsigned int lat_target_usec;	/* 0: no throttling */
+	unsigned int lat_step;		/* 0: writes not limited */
+	spinlock_t lat_lock;
+	unsigned long lat_win_start;	/* jiffies the current window began */
+	unsigned int lat_win_reads;	/* reads completed in the window */
+	u64 lat_win_min_ns;		/* and the lowest of their latencies */
+	atomic_t lat_inflight;		/* background writes queued */
+	wait_queue_head_t lat_wait;	/* writers over the limit */
+	unsigned long lat_throttled;	/* times a writer had to wait */
+	unsigned long lat_scale_downs;	/* windows over the target */
+
 #ifdef CONFIG_DEBUG_FS
 	struct dentry *debug_dir;
 	struct dentry *debug_stats;
@@ -114,6 +126,17 @@ int bdi_has_dirty_io(struct backing_dev_info *bdi);
 void bdi_arm_supers_timer(void);
 void bdi_wakeup_thread_delayed(struct backing_dev_info *bdi);
 void bdi_lock_two(struct bdi_writeback *wb1, struct bdi_writeback *wb2);
+void bdi_lat_throttle(struct backing_dev_info *bdi, spinlock_t *lock);
+void bdi_lat_write_done(struct backing_dev_info *bdi);
+void __bdi_lat_read_done(struct backing_dev_info *bdi, u64 start_ns);
+
+/* note the completion of a read queued at @start_ns (sched_clock) */
+static inline void bdi_lat_read_done(struct backing_dev_info *bdi,
+				     u64 start_ns)
+{
+	if (bdi->lat_target_usec)
+		__bdi_lat_read_done(bdi, start_ns);
+}
 
 extern spinlock_t bdi_lock;
 extern struct list_head bdi_list;
@@ -153,6 +153,7 @@ enum rq_flag_bits {
 	__REQ_FLUSH_SEQ,	/* request for flush sequence */
 	__REQ_IO_STAT,		/* account I/O stat */
 	__REQ_MIXED_MERGE,	/* merge of different types, fail separately */
+	__REQ_LAT_THROTTLE,	/* background write counted by bdi_lat_throttle() */
 	__REQ_NR_BITS,		/* stops here */
 };
 
@@ -193,6 +194,7 @@ enum rq_flag_bits {
 #define REQ_FLUSH_SEQ		(1 << __REQ_FLUSH_SEQ)
 #define REQ_IO_STAT		(1 << __REQ_IO_STAT)
 #define REQ_MIXED_MERGE		(1 << __REQ_MIXED_MERGE)
+#define REQ_LAT_THROTTLE	(1 << __REQ_LAT_THROTTLE)
 #define REQ_SECURE		(1 << __REQ_SECURE)
 
 #endif /* __LINUX_BLK_TYPES_H */
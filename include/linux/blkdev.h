@@ -125,8 +125,8 @@ struct request {
 	struct gendisk *rq_disk;
 	struct hd_struct *part;
 	unsigned long start_time;
+	unsigned long long start_time_ns;	/* for blkio and bdi_lat */
 #ifdef CONFIG_BLK_CGROUP
-	unsigned long long start_time_ns;
 	unsigned long long io_start_time_ns;    /* when passed to hardware */
 #endif
 	/* Number of scatter-gather DMA addr+len pairs after
@@ -1150,7 +1150,6 @@ static inline void put_dev_sector(Sector p)
 struct work_struct;
 int kblockd_schedule_work(struct request_queue *q, struct work_struct *work);
 
-#ifdef CONFIG_BLK_CGROUP
 /*
  * This should not be using sched_clock(). A real patch is in progress
  * to fix this up, until that is in place we need to disable preemption
@@ -1163,6 +1162,12 @@ static inline void set_start_time_ns(struct request *req)
 	preempt_enable();
 }
 
+static inline uint64_t rq_start_time_ns(struct request *req)
+{
+        return req->start_time_ns;
+}
+
+#ifdef CONFIG_BLK_CGROUP
 static inline void set_io_start_time_ns(struct request *req)
 {
 	preempt_disable();
@@ -1170,22 +1175,12 @@ static inline void set_io_start_time_ns(struct request *req)
 	preempt_enable();
 }
 
-static inline uint64_t rq_start_time_ns(struct request *req)
-{
-        return req->start_time_ns;
-}
-
 static inline uint64_t rq_io_start_time_ns(struct request *req)
 {
         return req->io_start_time_ns;
 }
 #else
-static inline void set_start_time_ns(struct request *req) {}
 static inline void set_io_start_time_ns(struct request *req) {}
-static inline uint64_t rq_start_time_ns(struct request *req)
-{
-	return 0;
-}
 static inline uint64_t rq_io_start_time_ns(struct request *req)
 {
 	return 0;
@@ -642,6 +642,8 @@ struct address_space {
 	struct mutex		i_mmap_mutex;	/* protect tree, count, list */
 	/* Protected by tree_lock together with the radix tree */
 	unsigned long		nrpages;	/* number of total pages */
+	unsigned long		nrshadows;	/* number of shadow entries */
+	struct list_head	shadow_list;	/* mappings with shadow entries */
 	pgoff_t			writeback_index;/* writeback starts here */
 	const struct address_space_operations *a_ops;	/* methods */
 	unsigned long		flags;		/* error bits/gfp mask */
@@ -927,6 +929,18 @@ struct fown_struct {
 /*
  * Track a single file's readahead state
  */
+/*
+ * Readahead window of an interleaved stream that is not the one currently
+ * described by file_ra_state start/size/async_size.
+ */
+struct file_ra_stream {
+	pgoff_t start;
+	unsigned int size;
+	unsigned int async_size;
+};
+
+#define RA_NR_STREAMS	2		/* saved interleaved streams per file */
+
 struct file_ra_state {
 	pgoff_t start;			/* where readahead started */
 	unsigned int size;		/* # of readahead pages */
@@ -936,6 +950,13 @@ struct file_ra_state {
 	unsigned int ra_pages;		/* Maximum readahead window */
 	unsigned int mmap_miss;		/* Cache miss stat for mmap accesses */
 	loff_t prev_pos;		/* Cache last read() position */
+
+	/* other sequential streams interleaved with the current one */
+	struct file_ra_stream streams[RA_NR_STREAMS];
+
+	pgoff_t stride_prev;		/* last random read index */
+	unsigned int stride;		/* distance to the previous one */
+	unsigned int stride_count;	/* # of consecutive equal strides */
 };
 
 /*
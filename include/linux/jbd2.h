@@ -241,7 +241,8 @@ typedef struct journal_superblock_s
 	__be32	s_max_trans_data;	/* Limit of data blocks per trans. */
 
 /* 0x0050 */
-	__u32	s_padding[44];
+	__be32	s_num_fc_blks;		/* blocks in the fast commit area */
+	__u32	s_padding[43];
 
 /* 0x0100 */
 	__u8	s_users[16*48];		/* ids of all fs'es sharing the log */
@@ -263,13 +264,15 @@ typedef struct journal_superblock_s
 #define JBD2_FEATURE_INCOMPAT_REVOKE		0x00000001
 #define JBD2_FEATURE_INCOMPAT_64BIT		0x00000002
 #define JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT	0x00000004
+#define JBD2_FEATURE_INCOMPAT_FAST_COMMIT	0x00000040
 
 /* Features known to this kernel version: */
 #define JBD2_KNOWN_COMPAT_FEATURES	JBD2_FEATURE_COMPAT_CHECKSUM
 #define JBD2_KNOWN_ROCOMPAT_FEATURES	0
 #define JBD2_KNOWN_INCOMPAT_FEATURES	(JBD2_FEATURE_INCOMPAT_REVOKE | \
 					JBD2_FEATURE_INCOMPAT_64BIT | \
-					JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT)
+					JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT | \
+					JBD2_FEATURE_INCOMPAT_FAST_COMMIT)
 
 #ifdef __KERNEL__
 
@@ -728,6 +731,8 @@ jbd2_time_diff(unsigned long start, unsigned long end)
  * @j_free: Journal free - how many free blocks are there in the journal?
  * @j_first: The block number of the first usable block
  * @j_last: The block number one beyond the last usable block
+ * @j_fc_first: The first block of the fast commit area
+ * @j_fc_last: The block number one beyond the fast commit area
  * @j_dev: Device where we store the journal
  * @j_blocksize: blocksize for the location where we store the journal.
  * @j_blk_offset: starting block offset for into the device where we store the
@@ -766,6 +771,8 @@ jbd2_time_diff(unsigned long start, unsigned long end)
  * @j_proc_entry: procfs entry for the jbd statistics directory
  * @j_stats: Overall statistics
  * @j_private: An opaque pointer to fs-private information.
+ * @j_fc_replay_callback: Called by recovery for the blocks of the fast commit
+ *     area
  */
 
 struct journal_s
@@ -874,6 +881,14 @@ struct journal_s
 	unsigned long		j_first;
 	unsigned long		j_last;
 
+	/*
+	 * The fast commit area, which the log stops short of: the client
+	 * writes records of its own there, outside of any transaction, and
+	 * gets them back from recovery.  Empty if the journal has none.
+	 */
+	unsigned long		j_fc_first;
+	unsigned long		j_fc_last;
+
 	/*
 	 * Device, blocksize and starting block offset for the location where we
 	 * store the journal.
@@ -1002,6 +1017,17 @@ struct journal_s
 	 * superblock pointer here
 	 */
 	void *j_private;
+
+	/*
+	 * Called by recovery, after the log has been replayed, with each
+	 * block of the fast commit area in turn and the ID of the first
+	 * transaction that didn't make it into the log.  Returns 0 to get
+	 * the next block, > 0 to stop, or an error.
+	 */
+	int			(*j_fc_replay_callback)(journal_t *journal,
+							struct buffer_head *bh,
+							unsigned int off,
+							tid_t tid);
 };
 
 /*
@@ -1152,6 +1178,11 @@ extern int	   jbd2_journal_errno      (journal_t *);
 extern void	   jbd2_journal_ack_err    (journal_t *);
 extern int	   jbd2_journal_clear_err  (journal_t *);
 extern int	   jbd2_journal_bmap(journal_t *, unsigned long, unsigned long long *);
+extern int	   jbd2_fc_init(journal_t *journal, unsigned int blocks);
+extern int	   jbd2_fc_release(journal_t *journal);
+extern struct buffer_head *jbd2_fc_get_buf(journal_t *journal,
+					   unsigned int off);
+extern int	   jbd2_fc_write_buf(journal_t *journal, struct buffer_head *bh);
 extern int	   jbd2_journal_force_commit(journal_t *);
 extern int	   jbd2_journal_file_inode(handle_t *handle, struct jbd2_inode *inode);
 extern int	   jbd2_journal_begin_ordered_truncate(journal_t *journal,
@@ -92,9 +92,21 @@ struct page {
 	};
 
 	/* Third double word block */
-	struct list_head lru;		/* Pageout list, eg. active_list
+	union {
+		struct list_head lru;	/* Pageout list, eg. active_list
 					 * protected by zone->lru_lock !
 					 */
+		struct {		/* slub per cpu partial pages */
+			struct page *next;	/* Next partial slab */
+#ifdef CONFIG_64BIT
+			int pages;	/* Nr of partial slabs left */
+			int pobjects;	/* Approximate # of objects */
+#else
+			short int pages;
+			short int pobjects;
+#endif
+		};
+	};
 
 	/* Remainder is not double word aligned */
 	union {
@@ -224,6 +236,10 @@ struct vm_area_struct {
 	struct file * vm_file;		/* File we map to (can be NULL). */
 	void * vm_private_data;		/* was vm_pte (shared mem) */
 
+#ifdef CONFIG_SWAP
+	atomic_long_t swap_readahead_info; /* last swap fault, window, hits */
+#endif
+
 #ifndef CONFIG_MMU
 	struct vm_region *vm_region;	/* NOMMU mapping region */
 #endif
@@ -362,6 +378,12 @@ struct mm_struct {
 #ifdef CONFIG_CPUMASK_OFFSTACK
 	struct cpumask cpumask_allocation;
 #endif
+#ifdef CONFIG_KSM
+	/* KSM statistics for /proc/<pid>/ksm_stat, under ksm_thread_mutex */
+	unsigned long ksm_rmap_items;		/* pages being scanned */
+	unsigned long ksm_merging_pages;	/* pages merged into ksm pages */
+	unsigned long ksm_zero_pages_merged;	/* pages merged into zero page */
+#endif
 };
 
 static inline void mm_init_cpumask(struct mm_struct *mm)
@@ -17,6 +17,12 @@
 #include <linux/io.h>
 #include <linux/mmc/host.h>
 
+/* Scatterlist of the next request, mapped ahead in ->pre_req() */
+struct sdhci_next {
+	unsigned int sg_count;
+	s32 cookie;
+};
+
 struct sdhci_host {
 	/* Data set by hardware interface driver */
 	const char *hw_name;	/* Hardware bus name */
@@ -140,6 +146,7 @@ struct sdhci_host {
 	unsigned int blocks;	/* remaining PIO blocks */
 
 	int sg_count;		/* Mapped sg entries */
+	struct sdhci_next next_data;	/* Pre-mapped next request */
 
 	u8 *adma_desc;		/* ADMA descriptor table */
 	u8 *align_buffer;	/* Bounce buffer */
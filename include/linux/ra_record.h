@@ -0,0 +1,43 @@
+#ifndef _LINUX_RA_RECORD_H
+#define _LINUX_RA_RECORD_H
+
+#include <linux/ioctl.h>
+
+/*
+ * /dev/ra_record: record the page cache misses of a process (or of every
+ * task) and replay them later as readahead.  See
+ * Documentation/vm/ra_record.txt.
+ */
+#define RA_RECORD_IOC_MAGIC	0xB4
+
+/* start recording misses of the thread group given as argument, 0 = all */
+#define RA_RECORD_START		_IO(RA_RECORD_IOC_MAGIC, 0)
+/* stop recording, keeping what was recorded */
+#define RA_RECORD_STOP		_IO(RA_RECORD_IOC_MAGIC, 1)
+/* stop recording and drop what was recorded */
+#define RA_RECORD_CLEAR		_IO(RA_RECORD_IOC_MAGIC, 2)
+
+#ifdef __KERNEL__
+#include <linux/fs.h>
+
+#ifdef CONFIG_RA_RECORD
+extern int ra_record_active;
+extern void __ra_record(struct file *file, pgoff_t offset,
+			unsigned long nr_pages);
+
+/* note a page cache miss of @nr_pages at @offset in @file */
+static inline void ra_record(struct file *file, pgoff_t offset,
+			     unsigned long nr_pages)
+{
+	if (unlikely(ra_record_active) && file)
+		__ra_record(file, offset, nr_pages);
+}
+#else
+static inline void ra_record(struct file *file, pgoff_t offset,
+			     unsigned long nr_pages)
+{
+}
+#endif /* CONFIG_RA_RECORD */
+#endif /* __KERNEL__ */
+
+#endif /* _LINUX_RA_RECORD_H */
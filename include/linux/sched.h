@@ -1222,6 +1222,8 @@ struct sched_statistics {
 	u64			nr_wakeups_affine_attempts;
 	u64			nr_wakeups_passive;
 	u64			nr_wakeups_idle;
+	u64			nr_wakeups_packed;
+	u64			nr_wakeups_spread;
 };
 #endif
 
@@ -1238,6 +1240,13 @@ struct sched_entity {
 
 	u64			nr_migrations;
 
+#ifdef CONFIG_SMP
+	/* runtime/period sampled at each wakeup, for wakeup packing */
+	u64			wake_stamp;
+	u64			wake_sum_exec_runtime;
+	unsigned long		wake_util;
+#endif
+
 #ifdef CONFIG_SCHEDSTATS
 	struct sched_statistics statistics;
 #endif
@@ -0,0 +1,78 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM readahead
+
+#if !defined(_TRACE_READAHEAD_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_READAHEAD_H
+
+#include <linux/types.h>
+#include <linux/tracepoint.h>
+#include <linux/fs.h>
+
+#define RA_PATTERN_INITIAL	0	/* start of file or fresh stream */
+#define RA_PATTERN_SEQUENTIAL	1	/* expected next window */
+#define RA_PATTERN_INTERLEAVED	2	/* one of several streams on a file */
+#define RA_PATTERN_CONTEXT	3	/* stream found from cached history */
+#define RA_PATTERN_STRIDE	4	/* fixed distance between reads */
+#define RA_PATTERN_RANDOM	5	/* no pattern, read as is */
+#define RA_PATTERN_MAX		6
+
+#define show_ra_pattern(pattern)					\
+	__print_symbolic(pattern,					\
+		{ RA_PATTERN_INITIAL,		"initial" },		\
+		{ RA_PATTERN_SEQUENTIAL,	"sequential" },		\
+		{ RA_PATTERN_INTERLEAVED,	"interleaved" },	\
+		{ RA_PATTERN_CONTEXT,		"context" },		\
+		{ RA_PATTERN_STRIDE,		"stride" },		\
+		{ RA_PATTERN_RANDOM,		"random" })
+
+TRACE_EVENT(readahead,
+
+	TP_PROTO(struct address_space *mapping, pgoff_t offset,
+		 unsigned long req_size, bool async, int pattern,
+		 pgoff_t start, unsigned long size, unsigned long async_size,
+		 int actual),
+
+	TP_ARGS(mapping, offset, req_size, async, pattern, start, size,
+		async_size, actual),
+
+	TP_STRUCT__entry(
+		__field(dev_t,		dev)
+		__field(ino_t,		ino)
+		__field(pgoff_t,	offset)
+		__field(unsigned long,	req_size)
+		__field(bool,		async)
+		__field(int,		pattern)
+		__field(pgoff_t,	start)
+		__field(unsigned long,	size)
+		__field(unsigned long,	async_size)
+		__field(int,		actual)
+	),
+
+	TP_fast_assign(
+		__entry->dev		= mapping->host->i_sb->s_dev;
+		__entry->ino		= mapping->host->i_ino;
+		__entry->offset		= offset;
+		__entry->req_size	= req_size;
+		__entry->async		= async;
+		__entry->pattern	= pattern;
+		__entry->start		= start;
+		__entry->size		= size;
+		__entry->async_size	= async_size;
+		__entry->actual		= actual;
+	),
+
+	TP_printk("dev %d,%d ino %lu %s %s offset=%lu req_size=%lu "
+		  "ra=%lu+%lu-%lu actual=%d",
+		MAJOR(__entry->dev), MINOR(__entry->dev),
+		(unsigned long)__entry->ino,
+		__entry->async ? "async" : "sync",
+		show_ra_pattern(__entry->pattern),
+		(unsigned long)__entry->offset, __entry->req_size,
+		(unsigned long)__entry->start, __entry->size,
+		__entry->async_size, __entry->actual)
+);
+
+#endif /* _TRACE_READAHEAD_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -573,6 +573,10 @@ struct rq {
 	/* try_to_wake_up() stats */
 	unsigned int ttwu_count;
 	unsigned int ttwu_local;
+
+	/* wakeup packing stats */
+	unsigned int ttwu_packed;
+	unsigned int ttwu_spread;
 #endif
 
 #ifdef CONFIG_SMP
@@ -4159,6 +4163,13 @@ static void __sched_fork(struct task_struct *p)
 	p->se.vruntime			= 0;
 	INIT_LIST_HEAD(&p->se.group_node);
 
+#ifdef CONFIG_SMP
+	/* new tasks are not packed until they have shown to be small */
+	p->se.wake_stamp		= 0;
+	p->se.wake_sum_exec_runtime	= 0;
+	p->se.wake_util			= SCHED_LOAD_SCALE;
+#endif
+
 #ifdef CONFIG_SCHEDSTATS
 	memset(&p->se.statistics, 0, sizeof(p->se.statistics));
 #endif
@@ -9212,6 +9223,40 @@ int __init sched_create_sysfs_power_savings_entries(struct sysdev_class *cls)
 }
 #endif /* CONFIG_SCHED_MC || CONFIG_SCHED_SMT */
 
+#ifdef CONFIG_SMP
+static ssize_t sched_wake_pack_util_show(struct sysdev_class *class,
+					 struct sysdev_class_attribute *attr,
+					 char *page)
+{
+	return sprintf(page, "%u\n", sysctl_sched_wake_pack_util);
+}
+static ssize_t sched_wake_pack_util_store(struct sysdev_class *class,
+					  struct sysdev_class_attribute *attr,
+					  const char *buf, size_t count)
+{
+	unsigned int util;
+
+	if (sscanf(buf, "%u", &util) != 1)
+		return -EINVAL;
+
+	if (util > SCHED_LOAD_SCALE)
+		return -EINVAL;
+
+	sysctl_sched_wake_pack_util = util;
+
+	return count;
+}
+static SYSDEV_CLASS_ATTR(sched_wake_pack_util, 0644,
+			 sched_wake_pack_util_show,
+			 sched_wake_pack_util_store);
+
+int __init sched_create_sysfs_wake_pack_entries(struct sysdev_class *cls)
+{
+	return sysfs_create_file(&cls->kset.kobj,
+				 &attr_sched_wake_pack_util.attr);
+}
+#endif /* CONFIG_SMP */
+
 /*
  * Update cpusets according to cpu_active mask.  If cpusets are
  * disabled, cpuset_update_active_cpus() becomes a simple wrapper
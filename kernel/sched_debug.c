@@ -457,6 +457,8 @@ void proc_sched_show_task(struct task_struct *p, struct seq_file *m)
 	P(se.statistics.nr_wakeups_affine_attempts);
 	P(se.statistics.nr_wakeups_passive);
 	P(se.statistics.nr_wakeups_idle);
+	P(se.statistics.nr_wakeups_packed);
+	P(se.statistics.nr_wakeups_spread);
 
 	{
 		u64 avg_atom, avg_per_cpu;
@@ -89,6 +89,17 @@ const_debug unsigned int sysctl_sched_migration_cost = 500000UL;
  */
 unsigned int __read_mostly sysctl_sched_shares_window = 10000000UL;
 
+#ifdef CONFIG_SMP
+/*
+ * Wakeup packing: a task whose recent utilization (runtime per wakeup
+ * period, in SCHED_LOAD_SCALE units) is below this threshold is woken on
+ * an already busy cpu instead of being spread to an idle one, so that
+ * idle cores can stay in their low power state or get unplugged.
+ * (default: 0, disabled)
+ */
+unsigned int __read_mostly sysctl_sched_wake_pack_util;
+#endif
+
 static const struct sched_class fair_sched_class;
 
 #if defined(CONFIG_BEST_TRADE_HOTPLUG)
@@ -1398,6 +1409,30 @@ static void dequeue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 
 #ifdef CONFIG_SMP
 
+/*
+ * Sample how much of the time since the previous wakeup this entity
+ * actually spent running, and fold it into a running average.
+ */
+static void update_wake_util(struct sched_entity *se)
+{
+	u64 now = local_clock();
+	u64 period = now - se->wake_stamp;
+	u64 runtime = se->sum_exec_runtime - se->wake_sum_exec_runtime;
+	unsigned long util;
+
+	if (se->wake_stamp && (s64)period > 0) {
+		if (runtime >= period)
+			util = SCHED_LOAD_SCALE;
+		else
+			util = div64_u64(runtime << SCHED_LOAD_SHIFT, period);
+
+		se->wake_util = (3 * se->wake_util + util) >> 2;
+	}
+
+	se->wake_stamp = now;
+	se->wake_sum_exec_runtime = se->sum_exec_runtime;
+}
+
 static void task_waking_fair(struct task_struct *p)
 {
 	struct sched_entity *se = &p->se;
@@ -1417,6 +1452,8 @@ static void task_waking_fair(struct task_struct *p)
 #endif
 
 	se->vruntime -= min_vruntime;
+
+	update_wake_util(se);
 }
 
 #ifdef CONFIG_FAIR_GROUP_SCHED
@@ -1632,6 +1669,61 @@ find_idlest_cpu(struct sched_group *group, struct task_struct *p, int this_cpu)
 	return idlest;
 }
 
+/*
+ * A cpu can take a packed wakeup if it is already running something,
+ * but not more than one task.
+ */
+static inline int wake_pack_cpu_ok(struct task_struct *p, int cpu)
+{
+	return cpumask_test_cpu(cpu, &p->cpus_allowed) && !idle_cpu(cpu) &&
+	       cpu_rq(cpu)->nr_running < 2;
+}
+
+/*
+ * Try and place a small task on an already busy CPU in the sched_domain,
+ * preferring prev_cpu and the waking cpu for cache affinity and then the
+ * lowest numbered cpu, so that the load drifts towards the low cpus and
+ * leaves the high ones idle.
+ * Returns -1 if packing is disabled, the task is not small or no busy
+ * cpu has room for it.
+ */
+static int select_pack_cpu(struct task_struct *p, struct sched_domain *sd,
+			   int cpu, int prev_cpu)
+{
+	int i;
+
+	if (!sysctl_sched_wake_pack_util)
+		return -1;
+
+	if (p->se.wake_util >= sysctl_sched_wake_pack_util)
+		goto spread;
+
+	if (wake_pack_cpu_ok(p, prev_cpu)) {
+		i = prev_cpu;
+		goto pack;
+	}
+
+	if (wake_pack_cpu_ok(p, cpu)) {
+		i = cpu;
+		goto pack;
+	}
+
+	for_each_cpu_and(i, sched_domain_span(sd), &p->cpus_allowed) {
+		if (wake_pack_cpu_ok(p, i))
+			goto pack;
+	}
+
+spread:
+	schedstat_inc(p, se.statistics.nr_wakeups_spread);
+	schedstat_inc(this_rq(), ttwu_spread);
+	return -1;
+
+pack:
+	schedstat_inc(p, se.statistics.nr_wakeups_packed);
+	schedstat_inc(this_rq(), ttwu_packed);
+	return i;
+}
+
 /*
  * Try and locate an idle CPU in the sched_domain.
  */
@@ -1762,6 +1854,10 @@ select_task_rq_fair(struct task_struct *p, int sd_flag, int wake_flags)
 	}
 
 	if (affine_sd) {
+		new_cpu = select_pack_cpu(p, affine_sd, cpu, prev_cpu);
+		if (new_cpu >= 0)
+			goto unlock;
+
 		if (cpu == prev_cpu || wake_affine(affine_sd, p, sync))
 			prev_cpu = cpu;
 
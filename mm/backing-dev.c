@@ -103,7 +103,12 @@ static int bdi_debug_stats_show(struct seq_file *m, void *v)
 		   "b_io:               %10lu\n"
 		   "b_more_io:          %10lu\n"
 		   "bdi_list:           %10u\n"
-		   "state:              %10lx\n",
+		   "state:              %10lx\n"
+		   "LatTarget:          %10u us\n"
+		   "LatStep:            %10u\n"
+		   "LatBgInflight:      %10d\n"
+		   "LatThrottled:       %10lu\n"
+		   "LatScaleDowns:      %10lu\n",
 		   (unsigned long) K(bdi_stat(bdi, BDI_WRITEBACK)),
 		   (unsigned long) K(bdi_stat(bdi, BDI_RECLAIMABLE)),
 		   K(bdi_thresh),
@@ -114,7 +119,12 @@ static int bdi_debug_stats_show(struct seq_file *m, void *v)
 		   nr_dirty,
 		   nr_io,
 		   nr_more_io,
-		   !list_empty(&bdi->bdi_list), bdi->state);
+		   !list_empty(&bdi->bdi_list), bdi->state,
+		   bdi->lat_target_usec,
+		   bdi->lat_step,
+		   atomic_read(&bdi->lat_inflight),
+		   bdi->lat_throttled,
+		   bdi->lat_scale_downs);
 #undef K
 
 	return 0;
@@ -223,12 +233,34 @@ static ssize_t max_ratio_store(struct device *dev,
 }
 BDI_SHOW(max_ratio, bdi->max_ratio)
 
+static ssize_t read_lat_target_us_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct backing_dev_info *bdi = dev_get_drvdata(dev);
+	char *end;
+	unsigned long usec;
+	ssize_t ret = -EINVAL;
+
+	usec = simple_strtoul(buf, &end, 10);
+	if (*buf && (end[0] == '\0' || (end[0] == '\n' && end[1] == '\0')) &&
+	    usec <= UINT_MAX) {
+		bdi->lat_target_usec = usec;
+		/* a new target starts from unlimited writes */
+		bdi->lat_step = 0;
+		wake_up_all(&bdi->lat_wait);
+		ret = count;
+	}
+	return ret;
+}
+BDI_SHOW(read_lat_target_us, bdi->lat_target_usec)
+
 #define __ATTR_RW(attr) __ATTR(attr, 0644, attr##_show, attr##_store)
 
 static struct device_attribute bdi_dev_attrs[] = {
 	__ATTR_RW(read_ahead_kb),
 	__ATTR_RW(min_ratio),
 	__ATTR_RW(max_ratio),
+	__ATTR_RW(read_lat_target_us),
 	__ATTR_NULL,
 };
 
@@ -687,6 +719,17 @@ int bdi_init(struct backing_dev_info *bdi)
 	bdi->write_bandwidth = INIT_BW;
 	bdi->avg_write_bandwidth = INIT_BW;
 
+	bdi->lat_target_usec = 0;
+	bdi->lat_step = 0;
+	spin_lock_init(&bdi->lat_lock);
+	bdi->lat_win_start = jiffies;
+	bdi->lat_win_reads = 0;
+	bdi->lat_win_min_ns = ~0ULL;
+	atomic_set(&bdi->lat_inflight, 0);
+	init_waitqueue_head(&bdi->lat_wait);
+	bdi->lat_throttled = 0;
+	bdi->lat_scale_downs = 0;
+
 	err = prop_local_init_percpu(&bdi->completions);
 
 	if (err) {
@@ -873,3 +916,140 @@ out:
 	return ret;
 }
 EXPORT_SYMBOL(wait_iff_congested);
+
+/*
+ * Read latency targeted throttling of background writes.
+ *
+ * The dirty limits bound how much data is waiting to be written, not how
+ * much of it the flusher puts into a device queue at once.  On eMMC a
+ * queue full of writes keeps the reads queued behind them waiting for
+ * hundreds of milliseconds, so when bdi->lat_target_usec is set, the
+ * block layer reports the latency of every read completing on the queue
+ * to bdi_lat_read_done().  At the end of each BDI_LAT_WINDOW the lowest
+ * of them is compared with the target: while it is over the target and
+ * background writes were queued, the number of background (async, non
+ * discard) writes let into the queue is halved, down to one.  Once reads
+ * meet the target again, or there are none, it is doubled back one step
+ * per window until writes are no longer limited.  Sync writes, and so
+ * fsync() and O_SYNC writers, are never held back.
+ */
+#define BDI_LAT_WINDOW		(HZ / 10)
+#define BDI_LAT_DEPTH		32
+#define BDI_LAT_MAX_STEP	(ilog2(BDI_LAT_DEPTH) + 1)
+
+static unsigned int bdi_lat_limit(struct backing_dev_info *bdi)
+{
+	unsigned int step = ACCESS_ONCE(bdi->lat_step);
+
+	if (!step || !bdi->lat_target_usec)
+		return INT_MAX;
+	return BDI_LAT_DEPTH >> (step - 1);
+}
+
+/* take a slot for a background write if there is one under the limit */
+static bool bdi_lat_get(struct backing_dev_info *bdi)
+{
+	unsigned int limit = bdi_lat_limit(bdi);
+	int cur;
+
+	do {
+		cur = atomic_read(&bdi->lat_inflight);
+		if (cur >= limit)
+			return false;
+	} while (atomic_cmpxchg(&bdi->lat_inflight, cur, cur + 1) != cur);
+
+	return true;
+}
+
+/* close the current window if it is over, lat_lock held */
+static void bdi_lat_window(struct backing_dev_info *bdi)
+{
+	unsigned int step = bdi->lat_step;
+
+	if (time_before(jiffies, bdi->lat_win_start + BDI_LAT_WINDOW))
+		return;
+
+	if (bdi->lat_win_reads && atomic_read(&bdi->lat_inflight) &&
+	    bdi->lat_win_min_ns > (u64)bdi->lat_target_usec * NSEC_PER_USEC) {
+		if (step < BDI_LAT_MAX_STEP) {
+			step++;
+			bdi->lat_scale_downs++;
+		}
+	} else if (step)
+		step--;
+
+	if (step < bdi->lat_step)
+		wake_up_all(&bdi->lat_wait);
+	bdi->lat_step = step;
+	bdi->lat_win_start = jiffies;
+	bdi->lat_win_reads = 0;
+	bdi->lat_win_min_ns = ~0ULL;
+}
+
+void __bdi_lat_read_done(struct backing_dev_info *bdi, u64 start_ns)
+{
+	unsigned long flags;
+	u64 lat;
+
+	spin_lock_irqsave(&bdi->lat_lock, flags);
+	lat = sched_clock() - start_ns;
+	bdi_lat_window(bdi);
+	bdi->lat_win_reads++;
+	if (lat < bdi->lat_win_min_ns)
+		bdi->lat_win_min_ns = lat;
+	spin_unlock_irqrestore(&bdi->lat_lock, flags);
+}
+
+/**
+ * bdi_lat_write_done - a background write counted by bdi_lat_throttle() is done
+ * @bdi: the backing_dev_info the write was queued on
+ */
+void bdi_lat_write_done(struct backing_dev_info *bdi)
+{
+	unsigned long flags;
+
+	if (atomic_dec_return(&bdi->lat_inflight) < bdi_lat_limit(bdi) &&
+	    waitqueue_active(&bdi->lat_wait))
+		wake_up(&bdi->lat_wait);
+
+	/* with no reads coming in, writes are what moves the windows on */
+	if (bdi->lat_step) {
+		spin_lock_irqsave(&bdi->lat_lock, flags);
+		bdi_lat_window(bdi);
+		spin_unlock_irqrestore(&bdi->lat_lock, flags);
+	}
+}
+
+/**
+ * bdi_lat_throttle - wait for room to queue a background write
+ * @bdi: the backing_dev_info the write is for
+ * @lock: the queue lock, held with interrupts disabled
+ *
+ * Counts a background write about to be queued on @bdi, after waiting
+ * for the number of those in flight to drop under the current limit.
+ * @lock is dropped while waiting.  Writes from reclaim are counted but
+ * never wait, they are what frees the memory the readers wait for.
+ */
+void bdi_lat_throttle(struct backing_dev_info *bdi, spinlock_t *lock)
+{
+	DEFINE_WAIT(wait);
+
+	if (current->flags & PF_MEMALLOC) {
+		atomic_inc(&bdi->lat_inflight);
+		return;
+	}
+	if (bdi_lat_get(bdi))
+		return;
+
+	bdi->lat_throttled++;
+	for (;;) {
+		prepare_to_wait_exclusive(&bdi->lat_wait, &wait,
+					  TASK_UNINTERRUPTIBLE);
+		if (bdi_lat_get(bdi))
+			break;
+		spin_unlock_irq(lock);
+		io_schedule();
+		spin_lock_irq(lock);
+	}
+	finish_wait(&bdi->lat_wait, &wait);
+}
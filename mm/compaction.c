@@ -14,6 +14,8 @@
 #include <linux/backing-dev.h>
 #include <linux/sysctl.h>
 #include <linux/sysfs.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
 #include "internal.h"
 
 #define CREATE_TRACE_POINTS
@@ -704,6 +706,193 @@ int compact_nodes(bool sync)
 	return COMPACT_COMPLETE;
 }
 
+/*
+ * kcompactd: per node background compaction.
+ *
+ * When a high-order allocation enters the slow path, kcompactd checks
+ * the fragmentation index of each zone in its node for kcompactd_order.
+ * A zone whose index is above kcompactd_threshold (i.e. an allocation of
+ * that order would fail because of fragmentation rather than a lack of
+ * free memory) is compacted asynchronously so that high-order
+ * allocations find a free block without stalling in direct compaction.
+ * As long as a run finds a zone to compact, kcompactd checks again
+ * every kcompactd_interval_ms; otherwise it sleeps until the next
+ * wakeup, so that an idle system is left alone.  Wakeups are ignored
+ * until kcompactd_interval_ms has passed since the last run.
+ */
+int sysctl_kcompactd_threshold = 500;
+int sysctl_kcompactd_order = PAGE_ALLOC_COSTLY_ORDER;
+int sysctl_kcompactd_interval_ms = 500;
+
+static bool kcompactd_zone_fragmented(struct zone *zone, int order)
+{
+	return fragmentation_index(zone, order) > sysctl_kcompactd_threshold;
+}
+
+/* Returns true if a zone was fragmented enough to be compacted */
+static bool kcompactd_do_work(pg_data_t *pgdat)
+{
+	bool compacted = false;
+	int zoneid;
+	int order = max(pgdat->kcompactd_max_order, sysctl_kcompactd_order);
+
+	pgdat->kcompactd_max_order = 0;
+	pgdat->kcompactd_last = jiffies;
+
+	for (zoneid = 0; zoneid < MAX_NR_ZONES; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+		struct compact_control cc = {
+			.nr_freepages = 0,
+			.nr_migratepages = 0,
+			.order = order,
+			.migratetype = MIGRATE_MOVABLE,
+			.zone = zone,
+			.sync = false,
+		};
+
+		if (!populated_zone(zone))
+			continue;
+
+		if (!kcompactd_zone_fragmented(zone, order) ||
+		    compaction_deferred(zone) ||
+		    compaction_suitable(zone, order) != COMPACT_CONTINUE)
+			continue;
+
+		compacted = true;
+		count_vm_event(KCOMPACTD_WAKE);
+		INIT_LIST_HEAD(&cc.freepages);
+		INIT_LIST_HEAD(&cc.migratepages);
+
+		compact_zone(zone, &cc);
+
+		VM_BUG_ON(!list_empty(&cc.freepages));
+		VM_BUG_ON(!list_empty(&cc.migratepages));
+
+		if (zone_watermark_ok(zone, order, low_wmark_pages(zone),
+				      0, 0)) {
+			zone->compact_considered = 0;
+			zone->compact_defer_shift = 0;
+			count_vm_event(KCOMPACTD_SUCCESS);
+		} else {
+			defer_compaction(zone);
+			count_vm_event(KCOMPACTD_FAIL);
+		}
+
+		if (kthread_should_stop())
+			break;
+	}
+
+	return compacted;
+}
+
+static int kcompactd(void *p)
+{
+	pg_data_t *pgdat = (pg_data_t *)p;
+	struct task_struct *tsk = current;
+	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
+	bool poll = false;
+
+	if (!cpumask_empty(cpumask))
+		set_cpus_allowed_ptr(tsk, cpumask);
+
+	set_freezable();
+
+	while (!kthread_should_stop()) {
+		long timeout = MAX_SCHEDULE_TIMEOUT;
+
+		/* poll only while the last run found something to compact */
+		if (poll && sysctl_kcompactd_interval_ms)
+			timeout = msecs_to_jiffies(sysctl_kcompactd_interval_ms);
+
+		wait_event_freezable_timeout(pgdat->kcompactd_wait,
+				pgdat->kcompactd_max_order ||
+				kthread_should_stop(), timeout);
+
+		if (kthread_should_stop())
+			break;
+
+		/* A zero interval means on demand only */
+		if (!sysctl_kcompactd_interval_ms && !pgdat->kcompactd_max_order)
+			continue;
+
+		poll = kcompactd_do_work(pgdat);
+	}
+
+	return 0;
+}
+
+/*
+ * Called from the page allocator slow path for high-order allocations.
+ * Wakes the kcompactd of the zone's node unless it ran within the last
+ * kcompactd_interval_ms or the zone is not fragmented at that order.
+ */
+void wakeup_kcompactd(struct zone *zone, int order)
+{
+	pg_data_t *pgdat = zone->zone_pgdat;
+	unsigned long next;
+
+	if (!order || !pgdat->kcompactd)
+		return;
+
+	next = pgdat->kcompactd_last +
+		msecs_to_jiffies(sysctl_kcompactd_interval_ms);
+	if (time_before(jiffies, next))
+		return;
+
+	if (!waitqueue_active(&pgdat->kcompactd_wait))
+		return;
+
+	if (!kcompactd_zone_fragmented(zone, order))
+		return;
+
+	if (pgdat->kcompactd_max_order < order)
+		pgdat->kcompactd_max_order = order;
+	wake_up_interruptible(&pgdat->kcompactd_wait);
+}
+
+/*
+ * This kcompactd start function will be called by init and node-hot-add.
+ */
+int kcompactd_run(int nid)
+{
+	pg_data_t *pgdat = NODE_DATA(nid);
+	int ret = 0;
+
+	if (pgdat->kcompactd)
+		return 0;
+
+	pgdat->kcompactd = kthread_run(kcompactd, pgdat, "kcompactd%d", nid);
+	if (IS_ERR(pgdat->kcompactd)) {
+		printk(KERN_ERR "Failed to start kcompactd on node %d\n", nid);
+		ret = PTR_ERR(pgdat->kcompactd);
+		pgdat->kcompactd = NULL;
+	}
+	return ret;
+}
+
+/*
+ * Called by memory hotplug when all memory in a node is offlined.
+ */
+void kcompactd_stop(int nid)
+{
+	struct task_struct *kcompactd = NODE_DATA(nid)->kcompactd;
+
+	if (kcompactd) {
+		kthread_stop(kcompactd);
+		NODE_DATA(nid)->kcompactd = NULL;
+	}
+}
+
+static int __init kcompactd_init(void)
+{
+	int nid;
+
+	for_each_node_state(nid, N_HIGH_MEMORY)
+		kcompactd_run(nid);
+	return 0;
+}
+module_init(kcompactd_init)
+
 /* The written value is actually unused, all memory is compacted */
 int sysctl_compact_memory;
 
@@ -730,7 +919,7 @@ ssize_t sysfs_compact_node(struct sys_device *dev,
 			struct sysdev_attribute *attr,
 			const char *buf, size_t count)
 {
-	compact_node(dev->id);
+	compact_node(dev->id, true);
 
 	return count;
 }
@@ -189,6 +189,24 @@ static unsigned int ksm_thread_pages_to_scan = 100;
 /* Milliseconds ksmd should sleep between batches */
 static unsigned int ksm_thread_sleep_millisecs = 20;
 
+/* Longest sleep ksmd backs off to while batches merge nothing, 0 = fixed */
+static unsigned int ksm_thread_max_sleep_millisecs = 1000;
+
+/* Milliseconds ksmd sleeps after the current batch */
+static unsigned int ksm_thread_cur_sleep_millisecs = 20;
+
+/* The number of merges so far: the yield of a batch is its increase */
+static unsigned long ksm_pages_merged;
+
+/* Whether to merge empty pages straight into the shared zero page */
+static unsigned int ksm_use_zero_pages = 1;
+
+/* The number of pages merged into the zero page */
+static unsigned long ksm_zero_pages_merged;
+
+/* Checksum of an empty page */
+static u32 zero_checksum __read_mostly;
+
 #define KSM_RUN_STOP	0
 #define KSM_RUN_MERGE	1
 #define KSM_RUN_UNMERGE	2
@@ -247,6 +265,7 @@ static inline struct rmap_item *alloc_rmap_item(void)
 static inline void free_rmap_item(struct rmap_item *rmap_item)
 {
 	ksm_rmap_items--;
+	rmap_item->mm->ksm_rmap_items--;
 	rmap_item->mm = NULL;	/* debug safety */
 	kmem_cache_free(rmap_item_cache, rmap_item);
 }
@@ -453,6 +472,7 @@ static void remove_node_from_stable_tree(struct stable_node *stable_node)
 			ksm_pages_sharing--;
 		else
 			ksm_pages_shared--;
+		rmap_item->mm->ksm_merging_pages--;
 		put_anon_vma(rmap_item->anon_vma);
 		rmap_item->address &= PAGE_MASK;
 		cond_resched();
@@ -540,6 +560,7 @@ static void remove_rmap_item_from_tree(struct rmap_item *rmap_item)
 			ksm_pages_sharing--;
 		else
 			ksm_pages_shared--;
+		rmap_item->mm->ksm_merging_pages--;
 
 		put_anon_vma(rmap_item->anon_vma);
 		rmap_item->address &= PAGE_MASK;
@@ -756,7 +777,7 @@ out:
  * replace_page - replace page in vma by new ksm page
  * @vma:      vma that holds the pte pointing to page
  * @page:     the page we are replacing by kpage
- * @kpage:    the ksm page we replace page by
+ * @kpage:    the ksm page we replace page by, or the zero page
  * @orig_pte: the original value of the pte
  *
  * Returns 0 on success, -EFAULT on failure.
@@ -771,6 +792,7 @@ static int replace_page(struct vm_area_struct *vma, struct page *page,
 	pte_t *ptep;
 	spinlock_t *ptl;
 	unsigned long addr;
+	pte_t newpte;
 	int err = -EFAULT;
 
 	addr = page_address_in_vma(page, vma);
@@ -796,12 +818,25 @@ static int replace_page(struct vm_area_struct *vma, struct page *page,
 		goto out;
 	}
 
-	get_page(kpage);
-	page_add_anon_rmap(kpage, vma, addr);
+	/*
+	 * The zero page is mapped as do_anonymous_page() maps it: special,
+	 * without a reference or rmap, so a write fault simply allocates a
+	 * fresh zeroed page.  That fault counts the new page in the rss,
+	 * so the page replaced here must leave it.
+	 */
+	if (kpage == ZERO_PAGE(addr)) {
+		newpte = pte_mkspecial(pfn_pte(page_to_pfn(kpage),
+					       vma->vm_page_prot));
+		dec_mm_counter(mm, MM_ANONPAGES);
+	} else {
+		get_page(kpage);
+		page_add_anon_rmap(kpage, vma, addr);
+		newpte = mk_pte(kpage, vma->vm_page_prot);
+	}
 
 	flush_cache_page(vma, addr, pte_pfn(*ptep));
 	ptep_clear_flush(vma, addr, ptep);
-	set_pte_at_notify(mm, addr, ptep, mk_pte(kpage, vma->vm_page_prot));
+	set_pte_at_notify(mm, addr, ptep, newpte);
 
 	page_remove_rmap(page);
 	if (!page_mapped(page))
@@ -1157,6 +1192,46 @@ static void stable_tree_append(struct rmap_item *rmap_item,
 		ksm_pages_sharing++;
 	else
 		ksm_pages_shared++;
+	rmap_item->mm->ksm_merging_pages++;
+	ksm_pages_merged++;
+}
+
+/*
+ * try_to_merge_zero_page - map an empty page to the shared zero page.
+ * Unlike a ksm page, the zero page needs no stable tree node: the
+ * rmap_item is simply left out of both trees.  follow_page() returns
+ * the zero page on the next scan, and scan_get_next_rmap_item() skips
+ * the address because that page is not PageAnon.
+ *
+ * This function returns 0 if the page was merged, -EFAULT otherwise.
+ */
+static int try_to_merge_zero_page(struct rmap_item *rmap_item,
+				  struct page *page)
+{
+	struct mm_struct *mm = rmap_item->mm;
+	struct vm_area_struct *vma;
+	int err = -EFAULT;
+
+	down_read(&mm->mmap_sem);
+	if (ksm_test_exit(mm))
+		goto out;
+	vma = find_vma(mm, rmap_item->address);
+	if (!vma || vma->vm_start > rmap_item->address)
+		goto out;
+	/* the zero page is never mlocked */
+	if (vma->vm_flags & VM_LOCKED)
+		goto out;
+
+	err = try_to_merge_one_page(vma, page,
+				    ZERO_PAGE(rmap_item->address));
+	if (!err) {
+		mm->ksm_zero_pages_merged++;
+		ksm_zero_pages_merged++;
+		ksm_pages_merged++;
+	}
+out:
+	up_read(&mm->mmap_sem);
+	return err;
 }
 
 /*
@@ -1208,6 +1283,15 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 		return;
 	}
 
+	/*
+	 * A page with the checksum of an empty page is most likely empty:
+	 * try the zero page before going through the unstable tree.  If
+	 * the page turns out not to be empty, carry on as usual.
+	 */
+	if (ksm_use_zero_pages && checksum == zero_checksum &&
+	    !try_to_merge_zero_page(rmap_item, page))
+		return;
+
 	tree_rmap_item =
 		unstable_tree_search_insert(rmap_item, page, &tree_page);
 	if (tree_rmap_item) {
@@ -1265,6 +1349,7 @@ static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
 	if (rmap_item) {
 		/* It has already been zeroed */
 		rmap_item->mm = mm_slot->mm;
+		rmap_item->mm->ksm_rmap_items++;
 		rmap_item->address = addr;
 		rmap_item->rmap_list = *rmap_list;
 		*rmap_list = rmap_item;
@@ -1428,6 +1513,27 @@ static int ksmd_should_run(void)
 	return (ksm_run & KSM_RUN_MERGE) && !list_empty(&ksm_mm_head.mm_list);
 }
 
+/*
+ * Adapt ksmd's sleep to the yield of the last batch: every batch that
+ * merges nothing lengthens the sleep by an eighth, up to
+ * max_sleep_millisecs, and any merge brings it straight back to
+ * sleep_millisecs.  A system whose mergeable memory has settled is then
+ * rescanned at a fraction of the configured rate.
+ */
+static void ksm_adapt_sleep(unsigned long merged)
+{
+	unsigned int sleep = ksm_thread_cur_sleep_millisecs;
+
+	if (merged || ksm_thread_max_sleep_millisecs <=
+			ksm_thread_sleep_millisecs)
+		sleep = ksm_thread_sleep_millisecs;
+	else
+		sleep = min(sleep + sleep / 8 + 1,
+			    ksm_thread_max_sleep_millisecs);
+	ksm_thread_cur_sleep_millisecs = max(sleep,
+					     ksm_thread_sleep_millisecs);
+}
+
 static int ksm_scan_thread(void *nothing)
 {
 	set_freezable();
@@ -1435,15 +1541,19 @@ static int ksm_scan_thread(void *nothing)
 
 	while (!kthread_should_stop()) {
 		mutex_lock(&ksm_thread_mutex);
-		if (ksmd_should_run())
+		if (ksmd_should_run()) {
+			unsigned long merged = ksm_pages_merged;
+
 			ksm_do_scan(ksm_thread_pages_to_scan);
+			ksm_adapt_sleep(ksm_pages_merged - merged);
+		}
 		mutex_unlock(&ksm_thread_mutex);
 
 		try_to_freeze();
 
 		if (ksmd_should_run()) {
 			schedule_timeout_interruptible(
-				msecs_to_jiffies(ksm_thread_sleep_millisecs));
+			    msecs_to_jiffies(ksm_thread_cur_sleep_millisecs));
 		} else {
 			wait_event_freezable(ksm_thread_wait,
 				ksmd_should_run() || kthread_should_stop());
@@ -1844,11 +1954,42 @@ static ssize_t sleep_millisecs_store(struct kobject *kobj,
 		return -EINVAL;
 
 	ksm_thread_sleep_millisecs = msecs;
+	ksm_thread_cur_sleep_millisecs = msecs;
 
 	return count;
 }
 KSM_ATTR(sleep_millisecs);
 
+static ssize_t max_sleep_millisecs_show(struct kobject *kobj,
+					struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_thread_max_sleep_millisecs);
+}
+
+static ssize_t max_sleep_millisecs_store(struct kobject *kobj,
+					 struct kobj_attribute *attr,
+					 const char *buf, size_t count)
+{
+	unsigned long msecs;
+	int err;
+
+	err = strict_strtoul(buf, 10, &msecs);
+	if (err || msecs > UINT_MAX)
+		return -EINVAL;
+
+	ksm_thread_max_sleep_millisecs = msecs;
+
+	return count;
+}
+KSM_ATTR(max_sleep_millisecs);
+
+static ssize_t cur_sleep_millisecs_show(struct kobject *kobj,
+					struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_thread_cur_sleep_millisecs);
+}
+KSM_ATTR_RO(cur_sleep_millisecs);
+
 static ssize_t pages_to_scan_show(struct kobject *kobj,
 				  struct kobj_attribute *attr, char *buf)
 {
@@ -1872,6 +2013,29 @@ static ssize_t pages_to_scan_store(struct kobject *kobj,
 }
 KSM_ATTR(pages_to_scan);
 
+static ssize_t use_zero_pages_show(struct kobject *kobj,
+				   struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_use_zero_pages);
+}
+
+static ssize_t use_zero_pages_store(struct kobject *kobj,
+				    struct kobj_attribute *attr,
+				    const char *buf, size_t count)
+{
+	unsigned long flag;
+	int err;
+
+	err = strict_strtoul(buf, 10, &flag);
+	if (err || flag > 1)
+		return -EINVAL;
+
+	ksm_use_zero_pages = flag;
+
+	return count;
+}
+KSM_ATTR(use_zero_pages);
+
 static ssize_t run_show(struct kobject *kobj, struct kobj_attribute *attr,
 			char *buf)
 {
@@ -1966,15 +2130,26 @@ static ssize_t full_scans_show(struct kobject *kobj,
 }
 KSM_ATTR_RO(full_scans);
 
+static ssize_t zero_pages_merged_show(struct kobject *kobj,
+				      struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_zero_pages_merged);
+}
+KSM_ATTR_RO(zero_pages_merged);
+
 static struct attribute *ksm_attrs[] = {
 	&sleep_millisecs_attr.attr,
+	&max_sleep_millisecs_attr.attr,
+	&cur_sleep_millisecs_attr.attr,
 	&pages_to_scan_attr.attr,
+	&use_zero_pages_attr.attr,
 	&run_attr.attr,
 	&pages_shared_attr.attr,
 	&pages_sharing_attr.attr,
 	&pages_unshared_attr.attr,
 	&pages_volatile_attr.attr,
 	&full_scans_attr.attr,
+	&zero_pages_merged_attr.attr,
 	NULL,
 };
 
@@ -1993,6 +2168,8 @@ static int __init ksm_init(void)
 	if (err)
 		goto out;
 
+	zero_checksum = calc_checksum(ZERO_PAGE(0));
+
 	ksm_thread = kthread_run(ksm_scan_thread, NULL, "ksmd");
 	if (IS_ERR(ksm_thread)) {
 		printk(KERN_ERR "ksm: creating kthread failed\n");
@@ -96,6 +96,8 @@ enum mem_cgroup_events_index {
 	MEM_CGROUP_EVENTS_COUNT,	/* # of pages paged in/out */
 	MEM_CGROUP_EVENTS_PGFAULT,	/* # of page-faults */
 	MEM_CGROUP_EVENTS_PGMAJFAULT,	/* # of major page-faults */
+	MEM_CGROUP_EVENTS_PGSCAN,	/* # of pages scanned by memcg reclaim */
+	MEM_CGROUP_EVENTS_PGSTEAL,	/* # of pages freed by memcg reclaim */
 	MEM_CGROUP_EVENTS_NSTATS,
 };
 /*
@@ -252,6 +254,12 @@ struct mem_cgroup {
 	atomic_t	refcnt;
 
 	int	swappiness;
+	/*
+	 * Weight of this group in reclaim under global memory pressure:
+	 * 0 leaves it to the global LRU, higher values reclaim from it
+	 * first and harder.  See mem_cgroup_priority_reclaim().
+	 */
+	int	reclaim_priority;
 	/* OOM-Killer disable */
 	int		oom_kill_disable;
 
@@ -599,6 +607,14 @@ void mem_cgroup_pgmajfault(struct mem_cgroup *mem, int val)
 	this_cpu_add(mem->stat->events[MEM_CGROUP_EVENTS_PGMAJFAULT], val);
 }
 
+/* account reclaim targeted at @mem: limit, soft limit and priority */
+void mem_cgroup_count_reclaim(struct mem_cgroup *mem, unsigned long scanned,
+			      unsigned long reclaimed)
+{
+	this_cpu_add(mem->stat->events[MEM_CGROUP_EVENTS_PGSCAN], scanned);
+	this_cpu_add(mem->stat->events[MEM_CGROUP_EVENTS_PGSTEAL], reclaimed);
+}
+
 static unsigned long mem_cgroup_read_events(struct mem_cgroup *mem,
 					    enum mem_cgroup_events_index idx)
 {
@@ -3671,6 +3687,54 @@ unsigned long mem_cgroup_soft_limit_reclaim(struct zone *zone, int order,
 	return nr_reclaimed;
 }
 
+/*
+ * Under global memory pressure, reclaim from the memory cgroups that have
+ * a reclaim_priority before the zone's LRU is shrunk as a whole, so that
+ * background groups give up their pages ahead of foreground ones.  Each
+ * group is asked for one batch of SWAP_CLUSTER_MAX pages per
+ * MEM_CGROUP_RECLAIM_PRIORITY_STEP of its priority: pressure is spread
+ * over the background groups in proportion to their priorities.
+ */
+#define MEM_CGROUP_RECLAIM_PRIORITY_MAX		100
+#define MEM_CGROUP_RECLAIM_PRIORITY_STEP	25
+
+unsigned long mem_cgroup_priority_reclaim(struct zone *zone, int order,
+					  gfp_t gfp_mask,
+					  unsigned long *total_scanned)
+{
+	int nid = zone_to_nid(zone), zid = zone_idx(zone);
+	unsigned long nr_reclaimed = 0;
+	unsigned long nr_scanned;
+	struct mem_cgroup *mem;
+
+	if (order > 0 || mem_cgroup_disabled())
+		return 0;
+
+	for_each_mem_cgroup_all(mem) {
+		int batches;
+
+		if (!mem->reclaim_priority)
+			continue;
+		batches = DIV_ROUND_UP(mem->reclaim_priority,
+				       MEM_CGROUP_RECLAIM_PRIORITY_STEP);
+		while (batches--) {
+			unsigned long reclaimed;
+
+			if (!mem_cgroup_zone_nr_lru_pages(mem, nid, zid,
+							  LRU_ALL_EVICTABLE))
+				break;
+			nr_scanned = 0;
+			reclaimed = mem_cgroup_shrink_node_zone(mem, gfp_mask,
+						false, zone, &nr_scanned);
+			*total_scanned += nr_scanned;
+			nr_reclaimed += reclaimed;
+			if (!reclaimed)
+				break;
+		}
+	}
+	return nr_reclaimed;
+}
+
 /*
  * This routine traverse page_cgroup in given list and drop them all.
  * *And* this routine doesn't reclaim page itself, just removes page_cgroup.
@@ -4071,6 +4135,8 @@ enum {
 	MCS_SWAP,
 	MCS_PGFAULT,
 	MCS_PGMAJFAULT,
+	MCS_PGSCAN,
+	MCS_PGSTEAL,
 	MCS_INACTIVE_ANON,
 	MCS_ACTIVE_ANON,
 	MCS_INACTIVE_FILE,
@@ -4095,6 +4161,8 @@ struct {
 	{"swap", "total_swap"},
 	{"pgfault", "total_pgfault"},
 	{"pgmajfault", "total_pgmajfault"},
+	{"pgscan", "total_pgscan"},
+	{"pgsteal", "total_pgsteal"},
 	{"inactive_anon", "total_inactive_anon"},
 	{"active_anon", "total_active_anon"},
 	{"inactive_file", "total_inactive_file"},
@@ -4127,6 +4195,10 @@ mem_cgroup_get_local_stat(struct mem_cgroup *mem, struct mcs_total_stat *s)
 	s->stat[MCS_PGFAULT] += val;
 	val = mem_cgroup_read_events(mem, MEM_CGROUP_EVENTS_PGMAJFAULT);
 	s->stat[MCS_PGMAJFAULT] += val;
+	val = mem_cgroup_read_events(mem, MEM_CGROUP_EVENTS_PGSCAN);
+	s->stat[MCS_PGSCAN] += val;
+	val = mem_cgroup_read_events(mem, MEM_CGROUP_EVENTS_PGSTEAL);
+	s->stat[MCS_PGSTEAL] += val;
 
 	/* per zone stat */
 	val = mem_cgroup_nr_lru_pages(mem, BIT(LRU_INACTIVE_ANON));
@@ -4300,6 +4372,30 @@ static int mem_cgroup_swappiness_write(struct cgroup *cgrp, struct cftype *cft,
 	return 0;
 }
 
+static u64 mem_cgroup_reclaim_priority_read(struct cgroup *cgrp,
+					    struct cftype *cft)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_cont(cgrp);
+
+	return memcg->reclaim_priority;
+}
+
+static int mem_cgroup_reclaim_priority_write(struct cgroup *cgrp,
+					     struct cftype *cft, u64 val)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_cont(cgrp);
+
+	if (val > MEM_CGROUP_RECLAIM_PRIORITY_MAX)
+		return -EINVAL;
+
+	/* the root group is what the global LRU reclaims anyway */
+	if (cgrp->parent == NULL)
+		return -EINVAL;
+
+	memcg->reclaim_priority = val;
+	return 0;
+}
+
 static void __mem_cgroup_threshold(struct mem_cgroup *memcg, bool swap)
 {
 	struct mem_cgroup_threshold_ary *t;
@@ -4697,6 +4793,11 @@ static struct cftype mem_cgroup_files[] = {
 		.read_u64 = mem_cgroup_swappiness_read,
 		.write_u64 = mem_cgroup_swappiness_write,
 	},
+	{
+		.name = "reclaim_priority",
+		.read_u64 = mem_cgroup_reclaim_priority_read,
+		.write_u64 = mem_cgroup_reclaim_priority_write,
+	},
 	{
 		.name = "move_charge_at_immigrate",
 		.read_u64 = mem_cgroup_move_charge_read,
@@ -5159,16 +5260,20 @@ static struct page *mc_handle_file_pte(struct vm_area_struct *vma,
 		pgoff = pte_to_pgoff(ptent);
 
 	/* page is moved even if it's not RSS of this task(page-faulted). */
-	page = find_get_page(mapping, pgoff);
-
 #ifdef CONFIG_SWAP
 	/* shmem/tmpfs may report page out on swap: account for that too. */
-	if (radix_tree_exceptional_entry(page)) {
-		swp_entry_t swap = radix_to_swp_entry(page);
-		if (do_swap_account)
-			*entry = swap;
-		page = find_get_page(&swapper_space, swap.val);
-	}
+	if (mapping_cap_swap_backed(mapping)) {
+		page = find_get_entry(mapping, pgoff);
+		if (radix_tree_exceptional_entry(page)) {
+			swp_entry_t swap = radix_to_swp_entry(page);
+			if (do_swap_account)
+				*entry = swap;
+			page = find_get_page(&swapper_space, swap.val);
+		}
+	} else
+		page = find_get_page(mapping, pgoff);
+#else
+	page = find_get_page(mapping, pgoff);
 #endif
 	return page;
 }
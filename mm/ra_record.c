@@ -0,0 +1,391 @@
+/*
+ * mm/ra_record.c - record page cache misses and replay them as readahead
+ *
+ * While recording, every page cache miss that goes through
+ * page_cache_sync_readahead() or the mmap fault path is noted as a
+ * (file, offset, pages) extent.  Reading /dev/ra_record returns the
+ * extents grouped by file in first-use order and sorted by offset within
+ * each file; writing such a list back to /dev/ra_record, typically early
+ * at the next boot or before the next launch of the same application,
+ * reads those ranges into the page cache with force_page_cache_readahead().
+ *
+ * See Documentation/vm/ra_record.txt.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/file.h>
+#include <linux/namei.h>
+#include <linux/mount.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/sched.h>
+#include <linux/pid.h>
+#include <linux/sort.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include <linux/miscdevice.h>
+#include <linux/ra_record.h>
+
+#define RA_RECORD_MAX_FILES	1024
+#define RA_RECORD_MAX_EXTENTS	16384
+#define RA_RECORD_LINE_MAX	(PATH_MAX + 64)
+
+struct ra_record_file {
+	struct list_head list;
+	struct address_space *mapping;
+	struct path path;		/* pins the inode, and so the mapping */
+	unsigned int index;		/* order of first use */
+};
+
+struct ra_record_extent {
+	struct ra_record_file *file;
+	pgoff_t start;
+	unsigned long nr;
+};
+
+int ra_record_active;
+static pid_t ra_record_tgid;		/* 0: record every task */
+static DEFINE_MUTEX(ra_record_mutex);
+static LIST_HEAD(ra_record_files);
+static unsigned int ra_record_nr_files;
+static struct ra_record_extent *ra_record_extents;
+static unsigned int ra_record_nr_extents;
+
+static struct ra_record_file *ra_record_get_file(struct file *file)
+{
+	struct address_space *mapping = file->f_mapping;
+	struct ra_record_file *rf;
+
+	list_for_each_entry(rf, &ra_record_files, list)
+		if (rf->mapping == mapping)
+			return rf;
+
+	if (ra_record_nr_files >= RA_RECORD_MAX_FILES)
+		return NULL;
+
+	rf = kmalloc(sizeof(*rf), GFP_KERNEL);
+	if (!rf)
+		return NULL;
+	rf->mapping = mapping;
+	rf->path = file->f_path;
+	path_get(&rf->path);
+	rf->index = ra_record_nr_files++;
+	list_add(&rf->list, &ra_record_files);
+	return rf;
+}
+
+void __ra_record(struct file *file, pgoff_t offset, unsigned long nr_pages)
+{
+	struct ra_record_extent *ext;
+	struct ra_record_file *rf;
+
+	if (ra_record_tgid && current->tgid != ra_record_tgid)
+		return;
+	if (!S_ISREG(file->f_mapping->host->i_mode))
+		return;
+
+	mutex_lock(&ra_record_mutex);
+	if (!ra_record_active)
+		goto out;
+
+	/* a miss that continues or overlaps the previous one extends it */
+	if (ra_record_nr_extents) {
+		ext = &ra_record_extents[ra_record_nr_extents - 1];
+		if (ext->file->mapping == file->f_mapping &&
+		    offset >= ext->start && offset <= ext->start + ext->nr) {
+			ext->nr = max(ext->nr, offset + nr_pages - ext->start);
+			goto out;
+		}
+	}
+
+	if (ra_record_nr_extents >= RA_RECORD_MAX_EXTENTS) {
+		printk(KERN_INFO "ra_record: extent table full, stopped\n");
+		ra_record_active = 0;
+		goto out;
+	}
+
+	rf = ra_record_get_file(file);
+	if (!rf)
+		goto out;
+
+	ext = &ra_record_extents[ra_record_nr_extents++];
+	ext->file = rf;
+	ext->start = offset;
+	ext->nr = nr_pages;
+out:
+	mutex_unlock(&ra_record_mutex);
+}
+
+/* ra_record_mutex must be held */
+static void ra_record_clear(void)
+{
+	struct ra_record_file *rf, *next;
+
+	ra_record_active = 0;
+	list_for_each_entry_safe(rf, next, &ra_record_files, list) {
+		list_del(&rf->list);
+		path_put(&rf->path);
+		kfree(rf);
+	}
+	ra_record_nr_files = 0;
+	ra_record_nr_extents = 0;
+	vfree(ra_record_extents);
+	ra_record_extents = NULL;
+}
+
+static int ra_record_start(pid_t pid)
+{
+	int ret = 0;
+
+	mutex_lock(&ra_record_mutex);
+	if (!ra_record_extents) {
+		ra_record_extents = vmalloc(RA_RECORD_MAX_EXTENTS *
+					   sizeof(*ra_record_extents));
+		if (!ra_record_extents) {
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+
+	ra_record_tgid = 0;
+	if (pid) {
+		struct task_struct *task;
+
+		rcu_read_lock();
+		task = find_task_by_vpid(pid);
+		if (task)
+			ra_record_tgid = task->tgid;
+		rcu_read_unlock();
+		if (!task) {
+			ret = -ESRCH;
+			goto out;
+		}
+	}
+	ra_record_active = 1;
+out:
+	mutex_unlock(&ra_record_mutex);
+	return ret;
+}
+
+static int ra_record_cmp(const void *a, const void *b)
+{
+	const struct ra_record_extent *x = a, *y = b;
+
+	if (x->file != y->file)
+		return x->file->index < y->file->index ? -1 : 1;
+	if (x->start != y->start)
+		return x->start < y->start ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Sort the extents by file (in first-use order) and offset, and merge
+ * the ones that overlap or touch.  ra_record_mutex must be held.
+ */
+static void ra_record_sort(void)
+{
+	struct ra_record_extent *ext = ra_record_extents;
+	unsigned int i, n = 0;
+
+	if (!ra_record_nr_extents)
+		return;
+
+	sort(ext, ra_record_nr_extents, sizeof(*ext), ra_record_cmp, NULL);
+
+	for (i = 1; i < ra_record_nr_extents; i++) {
+		if (ext[i].file == ext[n].file &&
+		    ext[i].start <= ext[n].start + ext[n].nr) {
+			ext[n].nr = max(ext[n].nr,
+					ext[i].start + ext[i].nr - ext[n].start);
+			continue;
+		}
+		ext[++n] = ext[i];
+	}
+	ra_record_nr_extents = n + 1;
+}
+
+static int ra_record_show(struct seq_file *m, void *v)
+{
+	unsigned int i;
+
+	mutex_lock(&ra_record_mutex);
+	ra_record_sort();
+	for (i = 0; i < ra_record_nr_extents; i++) {
+		struct ra_record_extent *ext = &ra_record_extents[i];
+
+		seq_printf(m, "%lu %lu ", (unsigned long)ext->start, ext->nr);
+		seq_path(m, &ext->file->path, "\n\\");
+		seq_putc(m, '\n');
+	}
+	mutex_unlock(&ra_record_mutex);
+	return 0;
+}
+
+/* per open state for replay */
+struct ra_replay {
+	char *line;		/* partial line carried between writes */
+	size_t len;
+	struct file *file;	/* last file replayed into */
+	char *name;		/* and its path */
+};
+
+/* undo the \ooo escapes seq_path() puts into the path */
+static void ra_replay_unescape(char *s)
+{
+	char *d = s;
+
+	while (*s) {
+		if (s[0] == '\\' && s[1] >= '0' && s[1] <= '7' &&
+		    s[2] >= '0' && s[2] <= '7' && s[3] >= '0' && s[3] <= '7') {
+			*d++ = ((s[1] - '0') << 6) | ((s[2] - '0') << 3) |
+				(s[3] - '0');
+			s += 4;
+		} else
+			*d++ = *s++;
+	}
+	*d = '\0';
+}
+
+static void ra_replay_line(struct ra_replay *rp, char *line)
+{
+	unsigned long start, nr;
+	int pos = 0;
+	char *name;
+
+	if (sscanf(line, "%lu %lu %n", &start, &nr, &pos) != 2 || !pos)
+		return;
+	name = line + pos;
+	ra_replay_unescape(name);
+
+	if (!rp->file || strcmp(rp->name, name)) {
+		struct file *file;
+
+		if (rp->file) {
+			fput(rp->file);
+			rp->file = NULL;
+		}
+		file = filp_open(name, O_RDONLY | O_LARGEFILE, 0);
+		if (IS_ERR(file))
+			return;
+		rp->file = file;
+		strlcpy(rp->name, name, PATH_MAX);
+	}
+
+	force_page_cache_readahead(rp->file->f_mapping, rp->file, start, nr);
+}
+
+static ssize_t ra_record_write(struct file *file, const char __user *buf,
+			       size_t count, loff_t *ppos)
+{
+	struct seq_file *m = file->private_data;
+	struct ra_replay *rp = m->private;
+	size_t done = 0;
+
+	while (done < count) {
+		char c;
+
+		if (get_user(c, buf + done))
+			return done ? done : -EFAULT;
+		done++;
+
+		if (c != '\n') {
+			if (rp->len < RA_RECORD_LINE_MAX - 1)
+				rp->line[rp->len++] = c;
+			continue;
+		}
+		rp->line[rp->len] = '\0';
+		rp->len = 0;
+		ra_replay_line(rp, rp->line);
+		cond_resched();
+	}
+	return done;
+}
+
+static long ra_record_ioctl(struct file *file, unsigned int cmd,
+			    unsigned long arg)
+{
+	switch (cmd) {
+	case RA_RECORD_START:
+		return ra_record_start((pid_t)arg);
+	case RA_RECORD_STOP:
+		ra_record_active = 0;
+		return 0;
+	case RA_RECORD_CLEAR:
+		mutex_lock(&ra_record_mutex);
+		ra_record_clear();
+		mutex_unlock(&ra_record_mutex);
+		return 0;
+	}
+	return -ENOTTY;
+}
+
+static int ra_record_open(struct inode *inode, struct file *file)
+{
+	struct ra_replay *rp;
+	int ret = -ENOMEM;
+
+	if (!capable(CAP_SYS_ADMIN))
+		return -EPERM;
+
+	rp = kzalloc(sizeof(*rp), GFP_KERNEL);
+	if (!rp)
+		return -ENOMEM;
+	rp->line = kmalloc(RA_RECORD_LINE_MAX, GFP_KERNEL);
+	rp->name = kmalloc(PATH_MAX, GFP_KERNEL);
+	if (!rp->line || !rp->name)
+		goto fail;
+
+	ret = single_open(file, ra_record_show, rp);
+	if (!ret)
+		return 0;
+fail:
+	kfree(rp->name);
+	kfree(rp->line);
+	kfree(rp);
+	return ret;
+}
+
+static int ra_record_release(struct inode *inode, struct file *file)
+{
+	struct seq_file *m = file->private_data;
+	struct ra_replay *rp = m->private;
+
+	if (rp->len) {
+		rp->line[rp->len] = '\0';
+		ra_replay_line(rp, rp->line);
+	}
+	if (rp->file)
+		fput(rp->file);
+	kfree(rp->name);
+	kfree(rp->line);
+	kfree(rp);
+	return single_release(inode, file);
+}
+
+static const struct file_operations ra_record_fops = {
+	.owner		= THIS_MODULE,
+	.open		= ra_record_open,
+	.read		= seq_read,
+	.write		= ra_record_write,
+	.llseek		= seq_lseek,
+	.unlocked_ioctl	= ra_record_ioctl,
+	.release	= ra_record_release,
+};
+
+static struct miscdevice ra_record_dev = {
+	.minor		= MISC_DYNAMIC_MINOR,
+	.name		= "ra_record",
+	.fops		= &ra_record_fops,
+	.mode		= S_IRUSR | S_IWUSR,
+};
+
+static int __init ra_record_init(void)
+{
+	return misc_register(&ra_record_dev);
+}
+module_init(ra_record_init)
@@ -17,6 +17,14 @@
 #include <linux/task_io_accounting_ops.h>
 #include <linux/pagevec.h>
 #include <linux/pagemap.h>
+#include <linux/hash.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include <linux/ra_record.h>
+
+#define CREATE_TRACE_POINTS
+#include <trace/events/readahead.h>
 
 /*
  * Initialise a struct file's readahead state.  Assumes that the caller has
@@ -177,7 +185,7 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 		rcu_read_lock();
 		page = radix_tree_lookup(&mapping->page_tree, page_offset);
 		rcu_read_unlock();
-		if (page)
+		if (page && !radix_tree_exceptional_entry(page))
 			continue;
 
 		page = page_cache_alloc_readahead(mapping);
@@ -334,7 +342,67 @@ static unsigned long get_next_ra_size(struct file_ra_state *ra,
  *
  * The code ramps up the readahead size aggressively at first, but slow down as
  * it approaches max_readhead.
+ *
+ * Several sequential streams interleaved on the same file each keep their
+ * own window: when a new window replaces the current one, the current one
+ * is saved in ra->streams[], and a read at the expected offset of a saved
+ * window swaps it back in and ramps it up as if it had never been
+ * replaced.
+ *
+ * Small reads that are neither sequential nor part of a known stream are
+ * checked for a fixed forward stride.  Once the same stride has been seen
+ * RA_STRIDE_MIN times in a row, the next few strided chunks of the same
+ * size are read along with the current one.
+ */
+
+/*
+ * Save the current window so that an interleaved stream can pick it up
+ * again later.  The oldest saved window is dropped.
  */
+static void ra_save_stream(struct file_ra_state *ra)
+{
+	int i;
+
+	if (!ra->size)
+		return;
+
+	for (i = RA_NR_STREAMS - 1; i > 0; i--)
+		ra->streams[i] = ra->streams[i - 1];
+	ra->streams[0].start = ra->start;
+	ra->streams[0].size = ra->size;
+	ra->streams[0].async_size = ra->async_size;
+}
+
+/*
+ * If @offset is where one of the saved streams expects its next read,
+ * make that stream current and save the current one in its place.
+ */
+static int ra_switch_stream(struct file_ra_state *ra, pgoff_t offset)
+{
+	struct file_ra_stream cur = {
+		.start = ra->start,
+		.size = ra->size,
+		.async_size = ra->async_size,
+	};
+	int i;
+
+	for (i = 0; i < RA_NR_STREAMS; i++) {
+		struct file_ra_stream *s = &ra->streams[i];
+
+		if (!s->size)
+			continue;
+		if (offset != s->start + s->size - s->async_size &&
+		    offset != s->start + s->size)
+			continue;
+
+		ra->start = s->start;
+		ra->size = s->size;
+		ra->async_size = s->async_size;
+		*s = cur;
+		return 1;
+	}
+	return 0;
+}
 
 /*
  * Count contiguously cached pages from @offset-1 to @offset-@max,
@@ -349,7 +417,7 @@ static pgoff_t count_history_pages(struct address_space *mapping,
 	pgoff_t head;
 
 	rcu_read_lock();
-	head = radix_tree_prev_hole(&mapping->page_tree, offset - 1, max);
+	head = page_cache_prev_hole(mapping, offset - 1, max);
 	rcu_read_unlock();
 
 	return offset - 1 - head;
@@ -382,6 +450,7 @@ static int try_context_readahead(struct address_space *mapping,
 	if (size >= offset)
 		size *= 2;
 
+	ra_save_stream(ra);
 	ra->start = offset;
 	ra->size = get_init_ra_size(size + req_size, max);
 	ra->async_size = ra->size;
@@ -389,6 +458,164 @@ static int try_context_readahead(struct address_space *mapping,
 	return 1;
 }
 
+#ifdef CONFIG_DEBUG_FS
+/*
+ * Per inode readahead statistics in <debugfs>/readahead/stats.  A "sync"
+ * readahead is started by a page cache miss, an "async" one by the reader
+ * reaching a PG_readahead marker, i.e. by using pages read ahead earlier.
+ * Inodes hash into a small table and evict each other on collision.
+ */
+#define RA_STAT_BITS	7
+#define RA_STAT_SLOTS	(1 << RA_STAT_BITS)
+
+struct ra_inode_stat {
+	dev_t dev;
+	unsigned long ino;
+	unsigned long sync;
+	unsigned long async;
+	unsigned long pages;
+	unsigned long pattern[RA_PATTERN_MAX];
+};
+
+static struct ra_inode_stat *ra_stats;
+static DEFINE_SPINLOCK(ra_stats_lock);
+static u32 ra_stats_enabled;
+
+static void ra_account(struct address_space *mapping, bool async,
+		       int pattern, int actual)
+{
+	struct inode *inode = mapping->host;
+	dev_t dev = inode->i_sb->s_dev;
+	struct ra_inode_stat *st;
+
+	if (!ra_stats_enabled || !ra_stats)
+		return;
+
+	spin_lock(&ra_stats_lock);
+	st = &ra_stats[hash_long(inode->i_ino ^ dev, RA_STAT_BITS)];
+	if (st->ino != inode->i_ino || st->dev != dev) {
+		memset(st, 0, sizeof(*st));
+		st->dev = dev;
+		st->ino = inode->i_ino;
+	}
+	if (async)
+		st->async++;
+	else
+		st->sync++;
+	if (actual > 0)
+		st->pages += actual;
+	st->pattern[pattern]++;
+	spin_unlock(&ra_stats_lock);
+}
+
+static int ra_stats_show(struct seq_file *m, void *v)
+{
+	struct ra_inode_stat st;
+	int i;
+
+	seq_printf(m, "dev\tino\tsync\tasync\tpages\tinitial\tseq\t"
+		   "inter\tcontext\tstride\trandom\n");
+	for (i = 0; i < RA_STAT_SLOTS; i++) {
+		spin_lock(&ra_stats_lock);
+		st = ra_stats[i];
+		spin_unlock(&ra_stats_lock);
+		if (!st.ino)
+			continue;
+		seq_printf(m, "%u:%u\t%lu\t%lu\t%lu\t%lu\t%lu\t%lu\t%lu\t"
+			   "%lu\t%lu\t%lu\n",
+			   MAJOR(st.dev), MINOR(st.dev), st.ino,
+			   st.sync, st.async, st.pages,
+			   st.pattern[RA_PATTERN_INITIAL],
+			   st.pattern[RA_PATTERN_SEQUENTIAL],
+			   st.pattern[RA_PATTERN_INTERLEAVED],
+			   st.pattern[RA_PATTERN_CONTEXT],
+			   st.pattern[RA_PATTERN_STRIDE],
+			   st.pattern[RA_PATTERN_RANDOM]);
+	}
+	return 0;
+}
+
+static int ra_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ra_stats_show, NULL);
+}
+
+/* any write clears the table */
+static ssize_t ra_stats_write(struct file *file, const char __user *buf,
+			      size_t count, loff_t *ppos)
+{
+	spin_lock(&ra_stats_lock);
+	memset(ra_stats, 0, RA_STAT_SLOTS * sizeof(*ra_stats));
+	spin_unlock(&ra_stats_lock);
+	return count;
+}
+
+static const struct file_operations ra_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= ra_stats_open,
+	.read		= seq_read,
+	.write		= ra_stats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init readahead_debugfs_init(void)
+{
+	struct dentry *dir;
+
+	ra_stats = kcalloc(RA_STAT_SLOTS, sizeof(*ra_stats), GFP_KERNEL);
+	if (!ra_stats)
+		return -ENOMEM;
+
+	dir = debugfs_create_dir("readahead", NULL);
+	if (!dir)
+		return -ENOMEM;
+	debugfs_create_bool("enable", 0644, dir, &ra_stats_enabled);
+	debugfs_create_file("stats", 0644, dir, NULL, &ra_stats_fops);
+	return 0;
+}
+late_initcall(readahead_debugfs_init);
+#else
+static inline void ra_account(struct address_space *mapping, bool async,
+			      int pattern, int actual)
+{
+}
+#endif /* CONFIG_DEBUG_FS */
+
+#define RA_STRIDE_MIN		2	/* equal strides before acting */
+#define RA_STRIDE_CHUNKS	8	/* max strided chunks read ahead */
+
+/*
+ * Detect reads of @req_size pages at a fixed forward stride.  Returns
+ * the number of chunks after @offset worth reading ahead, 0 if there is
+ * no stable stride yet.
+ */
+static unsigned long ra_stride_detect(struct file_ra_state *ra,
+				      pgoff_t offset, unsigned long req_size,
+				      unsigned long max)
+{
+	unsigned long stride = offset - ra->stride_prev;
+	unsigned long chunks;
+
+	if (offset > ra->stride_prev && stride > req_size && stride <= max &&
+	    stride == ra->stride) {
+		if (ra->stride_count < RA_STRIDE_MIN)
+			ra->stride_count++;
+	} else {
+		ra->stride = offset > ra->stride_prev ? stride : 0;
+		ra->stride_count = 0;
+	}
+	ra->stride_prev = offset;
+
+	if (ra->stride_count < RA_STRIDE_MIN)
+		return 0;
+
+	chunks = min_t(unsigned long, max / req_size, RA_STRIDE_CHUNKS);
+	/* the next miss will be one stride past the last chunk read */
+	ra->stride_prev = offset + chunks * ra->stride;
+	return chunks;
+}
+
 /*
  * A minimal readahead algorithm for trivial sequential/random reads.
  */
@@ -399,6 +626,9 @@ ondemand_readahead(struct address_space *mapping,
 		   unsigned long req_size)
 {
 	unsigned long max = max_sane_readahead(ra->ra_pages);
+	unsigned long chunks;
+	int pattern = RA_PATTERN_SEQUENTIAL;
+	int actual;
 
 	/*
 	 * start of file
@@ -411,11 +641,16 @@ ondemand_readahead(struct address_space *mapping,
 	 * Ramp up sizes, and push forward the readahead window.
 	 */
 	if ((offset == (ra->start + ra->size - ra->async_size) ||
-	     offset == (ra->start + ra->size))) {
-		ra->start += ra->size;
-		ra->size = get_next_ra_size(ra, max);
-		ra->async_size = ra->size;
-		goto readit;
+	     offset == (ra->start + ra->size)))
+		goto next_window;
+
+	/*
+	 * It's the expected callback offset of another stream interleaved
+	 * with the current one on this file.
+	 */
+	if (ra_switch_stream(ra, offset)) {
+		pattern = RA_PATTERN_INTERLEAVED;
+		goto next_window;
 	}
 
 	/*
@@ -428,17 +663,19 @@ ondemand_readahead(struct address_space *mapping,
 		pgoff_t start;
 
 		rcu_read_lock();
-		start = radix_tree_next_hole(&mapping->page_tree, offset+1,max);
+		start = page_cache_next_hole(mapping, offset + 1, max);
 		rcu_read_unlock();
 
 		if (!start || start - offset > max)
 			return 0;
 
+		ra_save_stream(ra);
 		ra->start = start;
 		ra->size = start - offset;	/* old async_size */
 		ra->size += req_size;
 		ra->size = get_next_ra_size(ra, max);
 		ra->async_size = ra->size;
+		pattern = RA_PATTERN_INTERLEAVED;
 		goto readit;
 	}
 
@@ -458,19 +695,55 @@ ondemand_readahead(struct address_space *mapping,
 	 * Query the page cache and look for the traces(cached history pages)
 	 * that a sequential stream would leave behind.
 	 */
-	if (try_context_readahead(mapping, ra, offset, req_size, max))
+	if (try_context_readahead(mapping, ra, offset, req_size, max)) {
+		pattern = RA_PATTERN_CONTEXT;
 		goto readit;
+	}
+
+	/*
+	 * strided reads: read the next chunks at the same stride now
+	 */
+	chunks = ra_stride_detect(ra, offset, req_size, max);
+	if (chunks) {
+		unsigned long i;
+
+		actual = 0;
+		for (i = 0; i <= chunks; i++) {
+			int ret = __do_page_cache_readahead(mapping, filp,
+					offset + i * ra->stride, req_size, 0);
+			if (ret > 0)
+				actual += ret;
+		}
+		trace_readahead(mapping, offset, req_size,
+				hit_readahead_marker, RA_PATTERN_STRIDE,
+				offset, req_size, 0, actual);
+		ra_account(mapping, hit_readahead_marker, RA_PATTERN_STRIDE,
+			   actual);
+		return actual;
+	}
 
 	/*
 	 * standalone, small random read
 	 * Read as is, and do not pollute the readahead state.
 	 */
-	return __do_page_cache_readahead(mapping, filp, offset, req_size, 0);
+	actual = __do_page_cache_readahead(mapping, filp, offset, req_size, 0);
+	trace_readahead(mapping, offset, req_size, hit_readahead_marker,
+			RA_PATTERN_RANDOM, offset, req_size, 0, actual);
+	ra_account(mapping, hit_readahead_marker, RA_PATTERN_RANDOM, actual);
+	return actual;
+
+next_window:
+	ra->start += ra->size;
+	ra->size = get_next_ra_size(ra, max);
+	ra->async_size = ra->size;
+	goto readit;
 
 initial_readahead:
+	ra_save_stream(ra);
 	ra->start = offset;
 	ra->size = get_init_ra_size(req_size, max);
 	ra->async_size = ra->size > req_size ? ra->size - req_size : ra->size;
+	pattern = RA_PATTERN_INITIAL;
 
 readit:
 	/*
@@ -483,7 +756,11 @@ readit:
 		ra->size += ra->async_size;
 	}
 
-	return ra_submit(ra, mapping, filp);
+	actual = ra_submit(ra, mapping, filp);
+	trace_readahead(mapping, offset, req_size, hit_readahead_marker,
+			pattern, ra->start, ra->size, ra->async_size, actual);
+	ra_account(mapping, hit_readahead_marker, pattern, actual);
+	return actual;
 }
 
 /**
@@ -504,6 +781,8 @@ void page_cache_sync_readahead(struct address_space *mapping,
 			       struct file_ra_state *ra, struct file *filp,
 			       pgoff_t offset, unsigned long req_size)
 {
+	ra_record(filp, offset, req_size);
+
 	/* no read-ahead */
 	if (!ra->ra_pages)
 		return;
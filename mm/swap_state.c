@@ -19,6 +19,8 @@
 #include <linux/pagevec.h>
 #include <linux/migrate.h>
 #include <linux/page_cgroup.h>
+#include <linux/kobject.h>
+#include <linux/sysfs.h>
 
 #include <asm/pgtable.h>
 
@@ -54,6 +56,34 @@ static struct {
 	unsigned long find_total;
 } swap_cache_info;
 
+/*
+ * Read ahead around the faulting virtual address rather than around the
+ * faulting swap slot: see swap_vma_readahead().
+ */
+bool swap_vma_ra_enabled __read_mostly = true;
+
+/*
+ * vma->swap_readahead_info packs the page aligned address of the last
+ * swap fault in the vma, the readahead window chosen for it, and the
+ * number of pages read ahead since then that were actually used.
+ */
+#define SWAP_RA_WIN_SHIFT	(PAGE_SHIFT / 2)
+#define SWAP_RA_HITS_MASK	((1UL << SWAP_RA_WIN_SHIFT) - 1)
+#define SWAP_RA_HITS_MAX	SWAP_RA_HITS_MASK
+#define SWAP_RA_WIN_MASK	(~PAGE_MASK & ~SWAP_RA_HITS_MASK)
+
+#define SWAP_RA_HITS(v)		((v) & SWAP_RA_HITS_MASK)
+#define SWAP_RA_WIN(v)		(((v) & SWAP_RA_WIN_MASK) >> SWAP_RA_WIN_SHIFT)
+#define SWAP_RA_ADDR(v)		((v) & PAGE_MASK)
+
+#define SWAP_RA_VAL(addr, win, hits)				\
+	(((addr) & PAGE_MASK) |					\
+	 (((unsigned long)(win) << SWAP_RA_WIN_SHIFT) & SWAP_RA_WIN_MASK) | \
+	 ((unsigned long)(hits) & SWAP_RA_HITS_MASK))
+
+/* largest window, also the number of ptes copied at once */
+#define SWAP_RA_MAX_WIN		32U
+
 void show_swap_cache_info(void)
 {
 	printk("%lu pages in swap cache\n", total_swapcache_pages);
@@ -254,20 +284,38 @@ void free_pages_and_swap_cache(struct page **pages, int nr)
 	}
 }
 
+static void swap_ra_hit(struct vm_area_struct *vma)
+{
+	unsigned long ra_info = atomic_long_read(&vma->swap_readahead_info);
+
+	if (SWAP_RA_HITS(ra_info) < SWAP_RA_HITS_MAX)
+		atomic_long_set(&vma->swap_readahead_info, ra_info + 1);
+}
+
 /*
  * Lookup a swap entry in the swap cache. A found page will be returned
  * unlocked and with its refcount incremented - we rely on the kernel
  * lock getting page table operations atomic even if we drop the page
  * lock before returning.
+ *
+ * A page that was brought in by readahead counts as a readahead hit,
+ * both globally and, when @vma is given, for the window of that vma.
  */
-struct page * lookup_swap_cache(swp_entry_t entry)
+struct page *lookup_swap_cache(swp_entry_t entry, struct vm_area_struct *vma)
 {
 	struct page *page;
 
 	page = find_get_page(&swapper_space, entry.val);
 
-	if (page)
+	if (page) {
 		INC_CACHE_INFO(find_success);
+		/* PG_readahead is PG_reclaim: leave writeback's alone */
+		if (!PageWriteback(page) && TestClearPageReadahead(page)) {
+			count_vm_event(SWAP_RA_HIT);
+			if (vma)
+				swap_ra_hit(vma);
+		}
+	}
 
 	INC_CACHE_INFO(find_total);
 	return page;
@@ -352,8 +400,30 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 	return found_page;
 }
 
+/*
+ * Read ahead the swap page at @entry unless it is cached already, and
+ * mark it so that lookup_swap_cache() can tell when it gets used.
+ * Returns false if the page could not be read.
+ */
+static bool swap_ra_page(swp_entry_t entry, gfp_t gfp_mask,
+			 struct vm_area_struct *vma, unsigned long addr)
+{
+	struct page *page;
+
+	page = find_get_page(&swapper_space, entry.val);
+	if (!page) {
+		page = read_swap_cache_async(entry, gfp_mask, vma, addr);
+		if (!page)
+			return false;
+		SetPageReadahead(page);
+		count_vm_event(SWAP_RA);
+	}
+	page_cache_release(page);
+	return true;
+}
+
 /**
- * swapin_readahead - swap in pages in hope we need them soon
+ * swap_cluster_readahead - swap in pages in hope we need them soon
  * @entry: swap entry of this memory
  * @gfp_mask: memory allocation flags
  * @vma: user vma this address belongs to
@@ -371,7 +441,7 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
  *
  * Caller must hold down_read on the vma->vm_mm if vma is not NULL.
  */
-struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
+struct page *swap_cluster_readahead(swp_entry_t entry, gfp_t gfp_mask,
 			struct vm_area_struct *vma, unsigned long addr)
 {
 	int nr_pages;
@@ -389,12 +459,218 @@ struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
 	nr_pages = valid_swaphandles(entry, &offset);
 	for (end_offset = offset + nr_pages; offset < end_offset; offset++) {
 		/* Ok, do the async read-ahead now */
-		page = read_swap_cache_async(swp_entry(swp_type(entry), offset),
-						gfp_mask, vma, addr);
-		if (!page)
+		if (offset == swp_offset(entry)) {
+			page = read_swap_cache_async(entry, gfp_mask, vma, addr);
+			if (!page)
+				break;
+			page_cache_release(page);
+		} else if (!swap_ra_page(swp_entry(swp_type(entry), offset),
+					 gfp_mask, vma, addr))
 			break;
-		page_cache_release(page);
 	}
 	lru_add_drain();	/* Push any new pages onto the LRU now */
 	return read_swap_cache_async(entry, gfp_mask, vma, addr);
 }
+
+/*
+ * Size the next readahead window of a vma from the hits of the last one:
+ * start reading ahead only once the faults move page by page in either
+ * direction, grow in powers of two while the pages get used, and halve
+ * at most per fault when they stop being used.
+ */
+static unsigned int swap_ra_window(unsigned long fpfn, unsigned long prev_pfn,
+				   unsigned int hits, unsigned int prev_win,
+				   unsigned int max_win)
+{
+	unsigned int win = hits + 2;
+
+	if (win == 2) {
+		if (fpfn != prev_pfn + 1 && fpfn != prev_pfn - 1)
+			win = 1;
+	} else {
+		unsigned int roundup = 4;
+
+		while (roundup < win)
+			roundup <<= 1;
+		win = roundup;
+	}
+
+	win = max(win, prev_win / 2);
+	return min(win, max_win);
+}
+
+/**
+ * swap_vma_readahead - swap in the neighbours of a faulting address
+ * @fentry: swap entry of the faulting page
+ * @gfp_mask: memory allocation flags
+ * @vma: user vma the faulting address belongs to
+ * @addr: faulting address
+ *
+ * Returns the struct page for @fentry, after queueing swapin of the
+ * swapped out ptes around @addr.
+ *
+ * With a compressed RAM swap device there is no seek time to save by
+ * reading neighbouring swap slots, and those slots hold whatever was
+ * reclaimed next to the page, often from another process.  Neighbouring
+ * virtual addresses of the same vma are much more likely to be needed
+ * next, so read those instead, in the direction the faults are moving,
+ * with a window sized by how many pages of the previous one were used.
+ *
+ * Caller must hold down_read on vma->vm_mm.
+ */
+static struct page *swap_vma_readahead(swp_entry_t fentry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr)
+{
+	unsigned long ra_info, faddr, fpfn, prev_pfn, lpfn, rpfn, start, end;
+	unsigned int max_win, win, i, nr;
+	pte_t ptes[SWAP_RA_MAX_WIN];
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+	pte_t *pte;
+
+	max_win = min(1U << page_cluster, SWAP_RA_MAX_WIN);
+	if (max_win == 1)
+		goto skip;
+
+	faddr = addr & PAGE_MASK;
+	fpfn = faddr >> PAGE_SHIFT;
+	ra_info = atomic_long_read(&vma->swap_readahead_info);
+	prev_pfn = SWAP_RA_ADDR(ra_info) >> PAGE_SHIFT;
+	win = swap_ra_window(fpfn, prev_pfn, SWAP_RA_HITS(ra_info),
+			     SWAP_RA_WIN(ra_info), max_win);
+	atomic_long_set(&vma->swap_readahead_info,
+			SWAP_RA_VAL(faddr, win, 0));
+	if (win == 1)
+		goto skip;
+
+	if (fpfn == prev_pfn + 1) {
+		lpfn = fpfn;
+		rpfn = fpfn + win;
+	} else if (prev_pfn == fpfn + 1) {
+		lpfn = fpfn >= win ? fpfn - win + 1 : 0;
+		rpfn = fpfn + 1;
+	} else {
+		unsigned int left = (win - 1) / 2;
+
+		lpfn = fpfn >= left ? fpfn - left : 0;
+		rpfn = fpfn + win - left;
+	}
+	/* stay within the vma and within the page table of @addr */
+	start = max3(lpfn, vma->vm_start >> PAGE_SHIFT,
+		     (faddr & PMD_MASK) >> PAGE_SHIFT);
+	end = min3(rpfn - 1, (vma->vm_end - 1) >> PAGE_SHIFT,
+		   ((faddr & PMD_MASK) + PMD_SIZE - 1) >> PAGE_SHIFT) + 1;
+	if (end - start <= 1)
+		goto skip;
+
+	pgd = pgd_offset(vma->vm_mm, faddr);
+	if (pgd_none(*pgd) || unlikely(pgd_bad(*pgd)))
+		goto skip;
+	pud = pud_offset(pgd, faddr);
+	if (pud_none(*pud) || unlikely(pud_bad(*pud)))
+		goto skip;
+	pmd = pmd_offset(pud, faddr);
+	if (pmd_none(*pmd) || pmd_trans_huge(*pmd) || unlikely(pmd_bad(*pmd)))
+		goto skip;
+
+	/*
+	 * A snapshot without the page table lock is good enough: a stale
+	 * entry only costs a wasted read, read_swap_cache_async() checks
+	 * that the swap entry is still in use.
+	 */
+	nr = end - start;
+	pte = pte_offset_map(pmd, start << PAGE_SHIFT);
+	for (i = 0; i < nr; i++)
+		ptes[i] = pte[i];
+	pte_unmap(pte);
+
+	for (i = 0; i < nr; i++) {
+		swp_entry_t entry;
+
+		if (pte_none(ptes[i]) || pte_present(ptes[i]) ||
+		    pte_file(ptes[i]))
+			continue;
+		entry = pte_to_swp_entry(ptes[i]);
+		if (unlikely(non_swap_entry(entry)) || entry.val == fentry.val)
+			continue;
+		swap_ra_page(entry, gfp_mask, vma, (start + i) << PAGE_SHIFT);
+	}
+	lru_add_drain();	/* Push any new pages onto the LRU now */
+skip:
+	return read_swap_cache_async(fentry, gfp_mask, vma, addr);
+}
+
+/**
+ * swapin_readahead - swap in a faulting page and read ahead of it
+ * @entry: swap entry of this memory
+ * @gfp_mask: memory allocation flags
+ * @vma: user vma this address belongs to
+ * @addr: faulting address
+ *
+ * Reads ahead by virtual address when swap_vma_ra_enabled is set (see
+ * /sys/kernel/mm/swap/vma_ra_enabled), by swap slot otherwise.
+ *
+ * Caller must hold down_read on vma->vm_mm.
+ */
+struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr)
+{
+	if (swap_vma_ra_enabled)
+		return swap_vma_readahead(entry, gfp_mask, vma, addr);
+	return swap_cluster_readahead(entry, gfp_mask, vma, addr);
+}
+
+#ifdef CONFIG_SYSFS
+static ssize_t vma_ra_enabled_show(struct kobject *kobj,
+				   struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", swap_vma_ra_enabled);
+}
+
+static ssize_t vma_ra_enabled_store(struct kobject *kobj,
+				    struct kobj_attribute *attr,
+				    const char *buf, size_t count)
+{
+	unsigned long enabled;
+	int err;
+
+	err = strict_strtoul(buf, 10, &enabled);
+	if (err || enabled > 1)
+		return -EINVAL;
+
+	swap_vma_ra_enabled = enabled;
+	return count;
+}
+static struct kobj_attribute vma_ra_enabled_attr =
+	__ATTR(vma_ra_enabled, 0644, vma_ra_enabled_show,
+	       vma_ra_enabled_store);
+
+static struct attribute *swap_attrs[] = {
+	&vma_ra_enabled_attr.attr,
+	NULL,
+};
+
+static struct attribute_group swap_attr_group = {
+	.attrs = swap_attrs,
+};
+
+static int __init swap_init_sysfs(void)
+{
+	struct kobject *swap_kobj;
+	int err;
+
+	swap_kobj = kobject_create_and_add("swap", mm_kobj);
+	if (!swap_kobj) {
+		printk(KERN_ERR "failed to create swap kobject\n");
+		return -ENOMEM;
+	}
+	err = sysfs_create_group(swap_kobj, &swap_attr_group);
+	if (err) {
+		printk(KERN_ERR "failed to register swap group\n");
+		kobject_put(swap_kobj);
+	}
+	return err;
+}
+subsys_initcall(swap_init_sysfs);
+#endif /* CONFIG_SYSFS */
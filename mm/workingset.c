@@ -0,0 +1,264 @@
+/*
+ * Workingset detection
+ *
+ * When a file page is reclaimed, a shadow entry is left in its slot of
+ * the page cache radix tree.  It remembers when, in terms of inactive
+ * list aging, the page was evicted, so that a later fault or read of the
+ * same page can tell how long it has been gone.
+ *
+ * Every zone counts the evictions and activations of its file pages in
+ * zone->inactive_age.  Both move pages off the inactive list, so the
+ * difference between the counter at refault time and the counter stored
+ * in the shadow entry, the refault distance, is the minimum number of
+ * extra inactive list slots the page would have needed to still be in
+ * memory at the time of the refault:
+ *
+ *   If a page is refaulted with a refault distance R, it was evicted
+ *   because R other pages were pushed off the inactive list after it,
+ *   and it would have survived on an inactive list R pages longer.
+ *
+ * The inactive list can grow at most into the space taken by the active
+ * list, so a page with a refault distance smaller than the size of the
+ * active list is part of the workingset that is being thrashed: it is
+ * activated right away instead of having to prove itself on the inactive
+ * list once more, and competes with the current active pages as a peer.
+ * Pages refaulting from further away are treated like any new page.
+ *
+ * Both cases are counted in /proc/vmstat as workingset_refault, and
+ * the activations as workingset_activate.
+ *
+ * Shadow entries, and the radix tree nodes holding them, outlive the
+ * pages they stand for: a file streamed through the page cache once
+ * would keep them until it is truncated or its inode is evicted, which
+ * never happens to an inode that stays in icache.  But the refault
+ * distance of a shadow entry is at least the number of pages evicted
+ * after it, so once there are more shadow entries than pages of memory
+ * the oldest of them can no longer lead to an activation.  Mappings are
+ * kept on a list from the time they get their first shadow entry, and
+ * above that limit a shrinker drops the shadow entries of the mappings
+ * at the head of the list, freeing the nodes that held only them.
+ */
+
+#include <linux/mm.h>
+#include <linux/mmzone.h>
+#include <linux/swap.h>
+#include <linux/fs.h>
+#include <linux/vmstat.h>
+#include <linux/radix-tree.h>
+#include <linux/pagevec.h>
+#include <linux/spinlock.h>
+#include <linux/module.h>
+
+#define EVICTION_SHIFT	(RADIX_TREE_EXCEPTIONAL_SHIFT + \
+			 ZONES_SHIFT + NODES_SHIFT)
+#define EVICTION_MASK	(~0UL >> EVICTION_SHIFT)
+
+static void *pack_shadow(unsigned long eviction, struct zone *zone)
+{
+	eviction = (eviction << NODES_SHIFT) | zone_to_nid(zone);
+	eviction = (eviction << ZONES_SHIFT) | zone_idx(zone);
+	eviction = (eviction << RADIX_TREE_EXCEPTIONAL_SHIFT);
+
+	return (void *)(eviction | RADIX_TREE_EXCEPTIONAL_ENTRY);
+}
+
+static void unpack_shadow(void *shadow, struct zone **zone,
+			  unsigned long *distance)
+{
+	unsigned long entry = (unsigned long)shadow;
+	unsigned long eviction;
+	unsigned long refault;
+	int zid, nid;
+
+	entry >>= RADIX_TREE_EXCEPTIONAL_SHIFT;
+	zid = entry & ((1UL << ZONES_SHIFT) - 1);
+	entry >>= ZONES_SHIFT;
+	nid = entry & ((1UL << NODES_SHIFT) - 1);
+	entry >>= NODES_SHIFT;
+	eviction = entry;
+
+	*zone = NODE_DATA(nid)->node_zones + zid;
+
+	/*
+	 * The counter in the shadow entry is truncated to the bits left
+	 * over by the node and zone: compute the distance in the same
+	 * width so that a wrapped inactive_age still gives the right
+	 * answer, as long as the page refaults within one wrap.
+	 */
+	refault = atomic_long_read(&(*zone)->inactive_age);
+	*distance = (refault - eviction) & EVICTION_MASK;
+}
+
+/**
+ * workingset_eviction - note the eviction of a page from memory
+ * @mapping: address space the page was backing
+ * @page: the page being evicted
+ *
+ * Returns a shadow entry to be stored in @mapping->page_tree in place
+ * of the evicted @page so that a later refault can be detected.
+ */
+void *workingset_eviction(struct address_space *mapping, struct page *page)
+{
+	struct zone *zone = page_zone(page);
+	unsigned long eviction;
+
+	eviction = atomic_long_inc_return(&zone->inactive_age);
+	return pack_shadow(eviction, zone);
+}
+
+/**
+ * workingset_refault - evaluate the refault of a previously evicted page
+ * @shadow: shadow entry of the evicted page
+ *
+ * Calculates and evaluates the refault distance of the previously
+ * evicted page in the context of the zone it was allocated in.
+ *
+ * Returns %true if the page should be activated, %false otherwise.
+ */
+bool workingset_refault(void *shadow)
+{
+	unsigned long refault_distance;
+	struct zone *zone;
+
+	unpack_shadow(shadow, &zone, &refault_distance);
+	inc_zone_state(zone, WORKINGSET_REFAULT);
+
+	if (refault_distance <= zone_page_state(zone, NR_ACTIVE_FILE)) {
+		inc_zone_state(zone, WORKINGSET_ACTIVATE);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * workingset_activation - note a page activation
+ * @page: page that is being activated
+ */
+void workingset_activation(struct page *page)
+{
+	atomic_long_inc(&page_zone(page)->inactive_age);
+}
+
+static LIST_HEAD(shadow_mappings);
+static DEFINE_SPINLOCK(shadow_mappings_lock);
+static atomic_long_t nr_shadows = ATOMIC_LONG_INIT(0);
+
+/**
+ * workingset_shadow_stored - account a shadow entry stored in a mapping
+ * @mapping: address space the shadow entry was stored in
+ *
+ * The caller must hold the mapping's tree_lock and update the radix tree.
+ */
+void workingset_shadow_stored(struct address_space *mapping)
+{
+	if (!mapping->nrshadows++) {
+		spin_lock(&shadow_mappings_lock);
+		list_add_tail(&mapping->shadow_list, &shadow_mappings);
+		spin_unlock(&shadow_mappings_lock);
+	}
+	atomic_long_inc(&nr_shadows);
+}
+
+/**
+ * workingset_shadow_removed - account a shadow entry removed from a mapping
+ * @mapping: address space the shadow entry was removed from
+ *
+ * The caller must hold the mapping's tree_lock and update the radix tree.
+ * A mapping leaves the shadow list with its last shadow entry, so that
+ * it can be freed once its pages and shadow entries are gone.
+ */
+void workingset_shadow_removed(struct address_space *mapping)
+{
+	if (!--mapping->nrshadows) {
+		spin_lock(&shadow_mappings_lock);
+		list_del_init(&mapping->shadow_list);
+		spin_unlock(&shadow_mappings_lock);
+	}
+	atomic_long_dec(&nr_shadows);
+}
+
+/*
+ * Delete the shadow entries of @mapping, looking at no more than
+ * @nr_to_scan slots.  Returns the number of slots looked at.  The caller
+ * holds both the tree_lock and shadow_mappings_lock.
+ */
+static unsigned long prune_mapping_shadows(struct address_space *mapping,
+					   unsigned long nr_to_scan)
+{
+	unsigned long indices[PAGEVEC_SIZE];
+	void **slots[PAGEVEC_SIZE];
+	unsigned long scanned = 0;
+	pgoff_t index = 0;
+	unsigned int nr, i;
+
+	while (scanned < nr_to_scan && mapping->nrshadows) {
+		nr = radix_tree_gang_lookup_slot(&mapping->page_tree, slots,
+						 indices, index, PAGEVEC_SIZE);
+		if (!nr)
+			break;
+		for (i = 0; i < nr; i++) {
+			void *entry;
+
+			/* look up again: a deletion may have moved the slot */
+			entry = radix_tree_lookup(&mapping->page_tree,
+						  indices[i]);
+			if (!radix_tree_exceptional_entry(entry))
+				continue;
+			radix_tree_delete(&mapping->page_tree, indices[i]);
+			mapping->nrshadows--;
+			atomic_long_dec(&nr_shadows);
+		}
+		scanned += nr;
+		index = indices[nr - 1] + 1;
+	}
+	return scanned;
+}
+
+static int shrink_shadows(struct shrinker *shrink, struct shrink_control *sc)
+{
+	unsigned long nr_to_scan = sc->nr_to_scan;
+	long excess;
+
+	if (nr_to_scan) {
+		spin_lock_irq(&shadow_mappings_lock);
+		while (nr_to_scan && !list_empty(&shadow_mappings) &&
+		       atomic_long_read(&nr_shadows) > totalram_pages) {
+			struct address_space *mapping;
+			unsigned long scanned = 1;
+
+			mapping = list_first_entry(&shadow_mappings,
+					struct address_space, shadow_list);
+			/* the tree_lock nests outside shadow_mappings_lock */
+			if (spin_trylock(&mapping->tree_lock)) {
+				scanned = prune_mapping_shadows(mapping,
+								nr_to_scan);
+				if (!mapping->nrshadows)
+					list_del_init(&mapping->shadow_list);
+				spin_unlock(&mapping->tree_lock);
+			}
+			/* give the other mappings a turn */
+			if (!list_empty(&mapping->shadow_list))
+				list_move_tail(&mapping->shadow_list,
+					       &shadow_mappings);
+			nr_to_scan -= min(scanned, nr_to_scan);
+		}
+		spin_unlock_irq(&shadow_mappings_lock);
+	}
+
+	excess = atomic_long_read(&nr_shadows) - totalram_pages;
+	if (excess <= 0)
+		return 0;
+	return min_t(long, excess, INT_MAX);
+}
+
+static struct shrinker shadow_shrinker = {
+	.shrink = shrink_shadows,
+	.seeks = DEFAULT_SEEKS,
+};
+
+static int __init workingset_init(void)
+{
+	register_shrinker(&shadow_shrinker);
+	return 0;
+}
+module_init(workingset_init);